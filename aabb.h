@@ -0,0 +1,91 @@
+#ifndef AABB_H
+#define AABB_H
+
+// axis-aligned bounding box, used by the acceleration structures
+class aabb_t
+{
+  public:
+  // constructors (overloaded), default box is empty (min > max)
+  aabb_t() : \
+	min(HUGE_VAL,HUGE_VAL,HUGE_VAL), \
+	max(-HUGE_VAL,-HUGE_VAL,-HUGE_VAL) \
+	{ };
+
+  aabb_t(const vec_t& imin, const vec_t& imax) : \
+	min(imin), \
+	max(imax) \
+	{ };
+
+  // copy constructor
+  aabb_t(const aabb_t& rhs) : \
+	min(rhs.min), \
+	max(rhs.max) \
+	{ };
+
+  // destructors (default ok)
+  ~aabb_t()
+	{ };
+
+  // assignment operator
+  const aabb_t& operator=(const aabb_t& rhs)
+	{
+	  if(this != &rhs) {
+	    min = rhs.min;
+	    max = rhs.max;
+	  }
+          return *this;
+	}
+
+  // friends
+  friend std::ostream& operator<<(std::ostream& s, const aabb_t& rhs)
+	{ return(s << "[" << rhs.min << "] [" << rhs.max << "]"); }
+
+  // methods
+  bool		empty() const	{ return min[0] > max[0]; }
+  vec_t		center() const	{ return 0.5 * (min + max); }
+
+  // grow box to enclose a point or another box
+  void grow(const vec_t& p)
+	{
+	  for(int i=0; i<3; i++) {
+	    if(p[i] < min[i]) min[i] = p[i];
+	    if(p[i] > max[i]) max[i] = p[i];
+	  }
+	}
+  void grow(const aabb_t& b)
+	{ grow(b.min); grow(b.max); }
+
+  // surface area (for the SAH), empty box has no area
+  double area() const
+	{
+	  if(empty()) return 0.0;
+	  double dx = max[0]-min[0], dy = max[1]-min[1], dz = max[2]-min[2];
+	  return 2.0 * (dx*dy + dy*dz + dz*dx);
+	}
+
+  // slab test, clips [tmin,tmax] to the box; inv is the componentwise
+  // inverse of the ray direction, NaNs (0 * inf) fail the comparisons and
+  // are ignored
+  bool clip(const vec_t& pos, const double *inv, double& tmin, double& tmax) const
+	{
+	  for(int i=0; i<3; i++) {
+	    double t0 = (min[i] - pos[i]) * inv[i];
+	    double t1 = (max[i] - pos[i]) * inv[i];
+	    if(inv[i] < 0.0) { double t = t0; t0 = t1; t1 = t; }
+	    if(t0 > tmin) tmin = t0;
+	    if(t1 < tmax) tmax = t1;
+	    if(tmin > tmax) return false;
+	  }
+	  return true;
+	}
+
+  // slab test against [tmin,tmax]
+  bool hits(const vec_t& pos, const double *inv, double tmin, double tmax) const
+	{ return clip(pos, inv, tmin, tmax); }
+
+  // data members (public, this is a plain record)
+  vec_t	min;
+  vec_t	max;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "simd.h"
+#include "vector.h"
+#include "pixel.h"
+#include "aabb.h"
+#include "material.h"
+#include "object.h"
+#include "packet.h"
+#include "pool.h"
+#include "accel.h"
+
+std::ostream& accel_t::put(std::ostream& s) const
+{
+  return(s << type << ": " << prims.size() << " objects");
+}
+
+void accel_t::build(const std::vector<object_t* >& objs)
+{
+  prims = objs;
+  pool.build(prims);
+}
+
+object_t* accel_t::closest(const vec_t& pos, const vec_t& dir,
+                           double& dist) const
+{
+	int		id = -1;
+
+  // check each object in batches; basic list iteration
+  pool.closest(pos, dir, 0, pool.size(), dist, id);
+
+  return(id < 0 ? NULL : pool.getobj(id));
+}
+
+void accel_t::closest(packet_t& pkt) const
+{
+  for(int k=0; k<pkt.n; k++)
+    pkt.obj[k] = closest(pkt.pos[k], pkt.dir[k], pkt.dist[k]);
+}
+
+object_t* accel_t::occluded(const vec_t& pos, const vec_t& dir,
+                            double maxdist) const
+{
+	int		id = pool.any(pos, dir, 0, pool.size(), maxdist);
+
+  return(id < 0 ? NULL : pool.getobj(id));
+}
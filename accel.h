@@ -0,0 +1,73 @@
+#ifndef ACCEL_H
+#define ACCEL_H
+
+#include <vector>
+
+// acceleration structure over the bounded objects of a model; the base
+// class is the plain linear scan, derived classes (bvh, grid) override
+// build(), closest() and occluded(); intersection goes through the
+// compiled pool. occluded() is an any-hit query: it returns the first
+// object found closer than maxdist, not necessarily the closest. the
+// packet closest() fills in obj and dist per lane, by default one lane
+// at a time
+class accel_t
+{
+  public:
+  // constructors (overloaded)
+  accel_t(std::string itype = std::string("list")) : \
+	type(itype), \
+	prims(), \
+	pool() \
+	{ };
+
+  // copy constructor
+  accel_t(const accel_t& rhs) : \
+	type(rhs.type), \
+	prims(rhs.prims), \
+	pool(rhs.pool) \
+	{ };
+
+  // destructors (default ok, objects are owned by the model)
+  virtual ~accel_t()
+	{ };
+
+  // operators (incl. assignment operator)
+  const accel_t& operator=(const accel_t& rhs)
+	{
+	  if(this != &rhs) {
+	    type = rhs.type;
+	    prims = rhs.prims;
+	    pool = rhs.pool;
+	  }
+          return *this;
+	}
+
+  // friends
+  friend std::ostream& operator<<(std::ostream& s, const accel_t& rhs)
+	{ return rhs.put(s); }
+  friend std::ostream& operator<<(std::ostream& s, accel_t *rhs)
+	{ return(s << (*rhs)); }
+
+  // methods
+  std::string	gettype() const	{ return type; }
+  int		size() const	{ return (int)prims.size(); }
+  // float hot data and kernels, takes effect at the next build()
+  void		setsingle(bool s)	{ pool.setsingle(s); }
+  void		setfast(bool f)		{ pool.setfast(f); }
+
+  virtual std::ostream&	put(std::ostream& s) const;
+
+  virtual void		build(const std::vector<object_t* >& objs);
+  virtual object_t*	closest(const vec_t& pos, const vec_t& dir,
+			        double& dist) const;
+  virtual void		closest(packet_t& pkt) const;
+  virtual object_t*	occluded(const vec_t& pos, const vec_t& dir,
+			         double maxdist) const;
+
+  protected:
+  std::string			type;	// e.g., list, bvh, grid
+  std::vector<object_t* >	prims;	// bounded objects
+  spheres_t			pool;	// compiled prims, same order
+};
+
+#endif
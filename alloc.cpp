@@ -0,0 +1,49 @@
+#include <cstdlib>
+#include <new>
+
+#include "alloc.h"
+
+static long	allocs = 0;		// allocations so far
+
+#ifdef ALLOC_COUNT
+void* operator new(std::size_t n)
+{
+	void	*p;
+
+  #pragma omp atomic
+  allocs++;
+
+  if(!(p = malloc(n ? n : 1))) throw std::bad_alloc();
+
+  return p;
+}
+
+void* operator new[](std::size_t n)
+{
+  return operator new(n);
+}
+
+void operator delete(void *p) throw()
+{
+  free(p);
+}
+
+void operator delete[](void *p) throw()
+{
+  free(p);
+}
+#endif
+
+long alloc_count()
+{
+  return allocs;
+}
+
+bool alloc_counting()
+{
+#ifdef ALLOC_COUNT
+  return true;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,11 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+// heap allocation accounting: built with -DALLOC_COUNT the global
+// operator new counts every allocation (all threads), so a render can
+// report what it allocated and show the steady state allocates nothing;
+// without it nothing is counted and alloc_count() stays 0
+long	alloc_count();
+bool	alloc_counting();
+
+#endif
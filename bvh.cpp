@@ -0,0 +1,283 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "simd.h"
+#include "vector.h"
+#include "pixel.h"
+#include "aabb.h"
+#include "material.h"
+#include "object.h"
+#include "packet.h"
+#include "pool.h"
+#include "accel.h"
+#include "bvh.h"
+
+// predicate for std::partition: is the centroid left of the split bin?
+class bvhbin_c
+{
+  public:
+  bvhbin_c(const std::vector<vec_t>& c, int a, double l, double s, int b) : \
+	cent(c), axis(a), lo(l), scale(s), split(b) \
+	{ };
+
+  bool operator()(int i) const
+	{ return bin(cent[i][axis]) < split; }
+
+  int bin(double x) const
+	{
+	  int b = (int)((x - lo) * scale);
+	  return b < 0 ? 0 : (b >= BVH_BINS ? BVH_BINS - 1 : b);
+	}
+
+  private:
+  const std::vector<vec_t>&	cent;
+  int				axis;
+  double			lo, scale;
+  int				split;
+};
+
+std::ostream& bvh_t::put(std::ostream& s) const
+{
+  accel_t::put(s);
+
+  return(s << ", " << nodes.size() << " nodes");
+}
+
+void bvh_t::build(const std::vector<object_t* >& objs)
+{
+	std::vector<aabb_t>		boxes(objs.size());
+	std::vector<vec_t>		cent(objs.size());
+	std::vector<int>		idx(objs.size());
+
+  nodes.clear();
+  prims.clear();
+  if(objs.empty()) return;
+
+  // per-object bounds and centroids (caller passes only bounded objects)
+  for(int i=0; i<(int)objs.size(); i++) {
+    objs[i]->getbounds(boxes[i]);
+    cent[i] = boxes[i].center();
+    idx[i] = i;
+  }
+
+  nodes.reserve(2 * objs.size());
+  build(idx, boxes, cent, 0, (int)objs.size(), 0);
+
+  // store primitives in leaf order so leaves index a contiguous range
+  for(int i=0; i<(int)idx.size(); i++) prims.push_back(objs[idx[i]]);
+  pool.build(prims);
+}
+
+int bvh_t::build(std::vector<int>& idx, const std::vector<aabb_t>& boxes,
+                 const std::vector<vec_t>& cent, int begin, int end, int depth)
+{
+	aabb_t		box, cbox;
+	int		n = end - begin, node = (int)nodes.size();
+	int		best_axis = -1, best_bin = 0, mid;
+	double		best_cost = HUGE_VAL;
+
+  // node bounds and centroid bounds
+  for(int i=begin; i<end; i++) {
+    box.grow(boxes[idx[i]]);
+    cbox.grow(cent[idx[i]]);
+  }
+
+  nodes.push_back(bvhnode_t());
+  nodes[node].box = box;
+
+  if(n <= 1) {
+    nodes[node].first = begin;
+    nodes[node].count = n;
+    return node;
+  }
+
+  // binned SAH: for each axis sweep the bins and cost every split plane
+  for(int axis=0; axis<3; axis++) {
+	aabb_t		bbox[BVH_BINS], lbox, rbox;
+	int		bcount[BVH_BINS], lcount[BVH_BINS];
+	double		larea[BVH_BINS], extent = cbox.max[axis] - cbox.min[axis];
+	int		rn = 0;
+
+    if(extent <= 0.0) continue;
+
+    bvhbin_c	binner(cent, axis, cbox.min[axis], BVH_BINS / extent, 0);
+
+    for(int b=0; b<BVH_BINS; b++) bcount[b] = 0;
+    for(int i=begin; i<end; i++) {
+      int b = binner.bin(cent[idx[i]][axis]);
+      bcount[b]++;
+      bbox[b].grow(boxes[idx[i]]);
+    }
+
+    // left-to-right prefix areas and counts
+    for(int b=0, ln=0; b<BVH_BINS-1; b++) {
+      lbox.grow(bbox[b]);
+      ln += bcount[b];
+      larea[b] = lbox.area();
+      lcount[b] = ln;
+    }
+
+    // right-to-left sweep, cost = A_l N_l + A_r N_r
+    for(int b=BVH_BINS-1; b>0; b--) {
+      rbox.grow(bbox[b]);
+      rn += bcount[b];
+      if(lcount[b-1] == 0 || rn == 0) continue;
+
+      double cost = larea[b-1] * lcount[b-1] + rbox.area() * rn;
+      if(cost < best_cost) {
+        best_cost = cost;
+        best_axis = axis;
+        best_bin = b;
+      }
+    }
+  }
+
+  // make a leaf if splitting isn't cheaper than intersecting everything
+  // (traversal and intersection costs both taken as 1)
+  if(n <= BVH_LEAF_MAX &&
+     (best_axis < 0 || 1.0 + best_cost / box.area() >= (double)n)) {
+    nodes[node].first = begin;
+    nodes[node].count = n;
+    return node;
+  }
+
+  if(best_axis >= 0 && depth < BVH_STACK / 2) {
+	double	extent = cbox.max[best_axis] - cbox.min[best_axis];
+
+    mid = (int)(std::partition(idx.begin() + begin, idx.begin() + end,
+            bvhbin_c(cent, best_axis, cbox.min[best_axis],
+                     BVH_BINS / extent, best_bin)) - idx.begin());
+  } else {
+    // coincident centroids (or too deep): fall back to a median split
+    mid = begin + n / 2;
+  }
+  if(best_axis < 0) best_axis = 0;
+
+  nodes[node].axis = best_axis;
+  build(idx, boxes, cent, begin, mid, depth + 1);
+  nodes[node].first = build(idx, boxes, cent, mid, end, depth + 1);
+
+  return node;
+}
+
+object_t* bvh_t::closest(const vec_t& pos, const vec_t& dir,
+                         double& dist) const
+{
+	// closest object thus far
+	int		id = -1;
+
+	// traversal state
+	int		stack[BVH_STACK], sp=0, n=0;
+	double		inv[3];
+
+  if(nodes.empty()) return NULL;
+
+  for(int i=0; i<3; i++) inv[i] = 1.0 / dir[i];
+
+  while(true) {
+	const bvhnode_t&	node = nodes[n];
+
+    if(node.box.hits(pos, inv, 0.0, dist)) {
+      if(node.count > 0) {
+        // leaf: batch test of its (contiguous) objects
+        pool.closest(pos, dir, node.first, node.count, dist, id);
+      } else {
+        // interior: descend into the near child, defer the far one
+        if(dir[node.axis] < 0.0) {
+          stack[sp++] = n + 1;
+          n = node.first;
+        } else {
+          stack[sp++] = node.first;
+          n = n + 1;
+        }
+        continue;
+      }
+    }
+
+    if(sp == 0) break;
+    n = stack[--sp];
+  }
+
+  return(id < 0 ? NULL : pool.getobj(id));
+}
+
+void bvh_t::closest(packet_t& pkt) const
+{
+	// traversal state: node and first active lane
+	int		stack[BVH_STACK], lanes[BVH_STACK], sp=0, n=0, lane=0;
+	char		mask[PACKET_MAX];
+
+  for(int k=0; k<pkt.n; k++) pkt.id[k] = -1;
+
+  while(!nodes.empty()) {
+	const bvhnode_t&	node = nodes[n];
+
+    // packet early-out: skip lanes that miss the box, the subtree is
+    // culled once all of them do (lanes before 'lane' missed a parent)
+    while(lane < pkt.n &&
+          !node.box.hits(pkt.pos[lane], pkt.inv[lane], 0.0, pkt.dist[lane]))
+      lane++;
+
+    if(lane < pkt.n) {
+      if(node.count > 0) {
+        // leaf: lanes that enter the box test its objects as a batch
+        for(int k=0; k<pkt.n; k++)
+          mask[k] = k == lane || (k > lane &&
+                    node.box.hits(pkt.pos[k], pkt.inv[k], 0.0, pkt.dist[k]));
+        pool.closest(pkt, mask, node.first, node.count);
+      } else {
+        // interior: near child first, as seen by the first active lane
+        lanes[sp] = lane;
+        if(pkt.dir[lane][node.axis] < 0.0) {
+          stack[sp++] = n + 1;
+          n = node.first;
+        } else {
+          stack[sp++] = node.first;
+          n = n + 1;
+        }
+        continue;
+      }
+    }
+
+    if(sp == 0) break;
+    n = stack[--sp];
+    lane = lanes[sp];
+  }
+
+  for(int k=0; k<pkt.n; k++)
+    pkt.obj[k] = pkt.id[k] < 0 ? NULL : pool.getobj(pkt.id[k]);
+}
+
+object_t* bvh_t::occluded(const vec_t& pos, const vec_t& dir,
+                          double maxdist) const
+{
+	int		stack[BVH_STACK], sp=0, n=0, id;
+	double		inv[3];
+
+  if(nodes.empty()) return NULL;
+
+  for(int i=0; i<3; i++) inv[i] = 1.0 / dir[i];
+
+  // same walk as closest(), but any hit short of maxdist ends it
+  while(true) {
+	const bvhnode_t&	node = nodes[n];
+
+    if(node.box.hits(pos, inv, 0.0, maxdist)) {
+      if(node.count > 0) {
+        if((id = pool.any(pos, dir, node.first, node.count, maxdist)) >= 0)
+          return pool.getobj(id);
+      } else {
+        stack[sp++] = node.first;
+        n = n + 1;
+        continue;
+      }
+    }
+
+    if(sp == 0) break;
+    n = stack[--sp];
+  }
+
+  return NULL;
+}
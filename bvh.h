@@ -0,0 +1,72 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+
+#define BVH_LEAF_MAX	4	// max primitives per leaf
+#define BVH_BINS	16	// SAH bins per axis
+#define BVH_STACK	64	// traversal stack depth
+
+// bounding volume hierarchy over the bounded objects of a model, built
+// top-down with the surface area heuristic and stored as a flat array
+// (left child follows its parent, right child index is kept in the node)
+class bvh_t : public accel_t
+{
+  private:
+  struct bvhnode_t
+  {
+	aabb_t	box;
+	int	first;		// leaf: first primitive, interior: right child
+	int	count;		// leaf: primitive count, interior: 0
+	int	axis;		// split axis (interior only)
+
+	bvhnode_t() : first(0), count(0), axis(0)	{ };
+  };
+
+  public:
+  // constructors
+  bvh_t() : \
+	accel_t("bvh"), \
+	nodes() \
+	{ };
+
+  // copy constructor
+  bvh_t(const bvh_t& rhs) : \
+	accel_t(rhs), \
+	nodes(rhs.nodes) \
+	{ };
+
+  // destructors (default ok, objects are owned by the model)
+  ~bvh_t()
+	{ };
+
+  // assignment operator
+  const bvh_t& operator=(const bvh_t& rhs)
+	{
+	  if(this != &rhs) {
+	    accel_t::operator=(rhs);
+	    nodes = rhs.nodes;
+	  }
+          return *this;
+	}
+
+  // members
+  int		nodecount() const { return (int)nodes.size(); }
+
+  std::ostream&	put(std::ostream& s) const;
+
+  void		build(const std::vector<object_t* >& objs);
+  object_t*	closest(const vec_t& pos, const vec_t& dir,
+		        double& dist) const;
+  void		closest(packet_t& pkt) const;
+  object_t*	occluded(const vec_t& pos, const vec_t& dir,
+		         double maxdist) const;
+
+  private:
+  int		build(std::vector<int>&, const std::vector<aabb_t>&,
+		      const std::vector<vec_t>&, int, int, int);
+
+  std::vector<bvhnode_t>	nodes;	// prims are kept in leaf order
+};
+
+#endif
@@ -2,6 +2,7 @@
 #include <string>
 #include <cassert>
 
+#include "simd.h"
 #include "vector.h"
 #include "pixel.h"
 #include "camera.h"
@@ -0,0 +1,37 @@
+#include <iostream>
+#include <cstring>
+#include <cmath>
+
+#include "fastmath.h"
+
+void fastmath_report(std::ostream& s)
+{
+	double	x, fs, fc, e_sqrt=0.0, e_sin=0.0, e_pow=0.0;
+	int	n = 4096;
+
+  // sqrt over a few decades (discriminants), relative
+  for(int i=0; i<n; i++) {
+    x = pow(10.0, -4.0 + 12.0 * i / n);
+    e_sqrt = fmax(e_sqrt, fabs(fast_sqrt(x) - sqrt(x)) / sqrt(x));
+    // the float kernels' version
+    fs = fast_sqrt((float)x);
+    e_sqrt = fmax(e_sqrt, fabs(fs - sqrt(x)) / sqrt(x));
+  }
+
+  // sin and cos over one turn and a bit, absolute
+  for(int i=0; i<n; i++) {
+    x = -M_PI + 4.0 * M_PI * i / n;
+    fast_sincos(x, fs, fc);
+    e_sin = fmax(e_sin, fmax(fabs(fs - sin(x)), fabs(fc - cos(x))));
+  }
+
+  // the specular power, relative per unit of exponent
+  for(int i=1; i<n; i++) {
+    x = (double)i / n;
+    e_pow = fmax(e_pow, fabs(fast_pow(x, 32) - pow(x, 32.0)) / pow(x, 32.0) / 32.0);
+  }
+
+  s << "math fast: sqrt " << e_sqrt << " (bound " << FAST_SQRT_ERR << "), ";
+  s << "sin/cos " << e_sin << " (bound " << FAST_SIN_ERR << "), ";
+  s << "pow " << e_pow << " (bound " << FAST_POW_ERR << ")" << std::endl;
+}
@@ -0,0 +1,145 @@
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <cstring>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// approximate math for the 'math fast' render tier (options block), used
+// in place of libm in the hot kernels. each comes with a bound on its
+// error against the exact tier, see fastmath_report()
+#define FAST_SQRT_ERR	5e-7		// relative
+#define FAST_SIN_ERR	1e-7		// absolute, sin and cos
+#define FAST_POW_ERR	2.3e-16		// relative, per unit of exponent
+
+// sqrt as x * rsqrt(x): hardware reciprocal sqrt estimate (12 bits) plus
+// one newton step. x must be >= 0 and in float range; rsqrt(0) is inf,
+// so 0 is special cased (masked in the vector versions) to give 0
+static inline double fast_sqrt(double x)
+{
+	double	y;
+
+  if(x == 0.0) return(0.0);
+
+#if defined(__SSE2__)
+  y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss((float)x)));
+#else
+	float	f = (float)x;
+	int	i;
+
+  // bit trick estimate, two float steps to get past the hardware's
+  memcpy(&i, &f, sizeof(f));
+  i = 0x5f375a86 - (i >> 1);
+  memcpy(&f, &i, sizeof(f));
+  f = f * (1.5f - 0.5f * (float)x * f * f);
+  y = f * (1.5f - 0.5f * (float)x * f * f);
+#endif
+  y = y * (1.5 - 0.5 * x * y * y);
+
+  return(x * y);
+}
+
+#if defined(__SSE2__)
+static inline __m128 fast_sqrt(__m128 x)
+{
+	__m128	y = _mm_rsqrt_ps(x);
+
+  y = _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f),
+        _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), x), _mm_mul_ps(y, y))));
+
+  return(_mm_andnot_ps(_mm_cmpeq_ps(x, _mm_setzero_ps()), _mm_mul_ps(x, y)));
+}
+
+// float: newton step in float, as in the float kernels
+static inline float fast_sqrt(float x)
+{
+  return(_mm_cvtss_f32(fast_sqrt(_mm_set_ss(x))));
+}
+
+static inline __m128d fast_sqrt(__m128d x)
+{
+	__m128d	y = _mm_cvtps_pd(_mm_rsqrt_ps(_mm_cvtpd_ps(x)));
+
+  y = _mm_mul_pd(y, _mm_sub_pd(_mm_set1_pd(1.5),
+        _mm_mul_pd(_mm_mul_pd(_mm_set1_pd(0.5), x), _mm_mul_pd(y, y))));
+
+  return(_mm_andnot_pd(_mm_cmpeq_pd(x, _mm_setzero_pd()), _mm_mul_pd(x, y)));
+}
+#else
+static inline float fast_sqrt(float x)
+{
+  return((float)fast_sqrt((double)x));
+}
+#endif
+
+#if defined(__AVX__)
+static inline __m256 fast_sqrt(__m256 x)
+{
+	__m256	y = _mm256_rsqrt_ps(x);
+
+  y = _mm256_mul_ps(y, _mm256_sub_ps(_mm256_set1_ps(1.5f),
+        _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), x),
+                      _mm256_mul_ps(y, y))));
+
+  return(_mm256_andnot_ps(_mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_EQ_OQ),
+                          _mm256_mul_ps(x, y)));
+}
+
+static inline __m256d fast_sqrt(__m256d x)
+{
+	__m256d	y = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(x)));
+
+  y = _mm256_mul_pd(y, _mm256_sub_pd(_mm256_set1_pd(1.5),
+        _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(0.5), x),
+                      _mm256_mul_pd(y, y))));
+
+  return(_mm256_andnot_pd(_mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_EQ_OQ),
+                          _mm256_mul_pd(x, y)));
+}
+#endif
+
+// x^n for integer n by repeated squaring (n = 32 is 5 multiplies)
+static inline double fast_pow(double x, int n)
+{
+	double	r = 1.0;
+
+  if(n < 0) return(1.0 / fast_pow(x, -n));
+  for(; n > 0; n >>= 1) {
+    if(n & 1) r *= x;
+    x *= x;
+  }
+
+  return(r);
+}
+
+// sin of x in [-pi,pi]: folded to [-pi/2,pi/2], then taylor to x^11
+static inline double fast_sin_pi(double x)
+{
+	double	x2;
+
+  if(x >  M_PI_2) x =  M_PI - x;
+  if(x < -M_PI_2) x = -M_PI - x;
+  x2 = x * x;
+
+  return(x * (1.0 - x2 / 6.0 * (1.0 - x2 / 20.0 * (1.0 - x2 / 42.0 *
+             (1.0 - x2 / 72.0 * (1.0 - x2 / 110.0))))));
+}
+
+static inline void fast_sincos(double x, double& s, double& c)
+{
+  // reduce to [-pi,pi], cos(x) is sin(x + pi/2)
+  x -= 2.0 * M_PI * floor(x / (2.0 * M_PI) + 0.5);
+  s = fast_sin_pi(x);
+  x += M_PI_2;
+  c = fast_sin_pi(x > M_PI ? x - 2.0 * M_PI : x);
+}
+
+// measure the fast functions against libm over their working ranges and
+// print the worst errors found next to the bounds above
+void fastmath_report(std::ostream& s);
+
+#endif
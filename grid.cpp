@@ -0,0 +1,227 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+#include "simd.h"
+#include "vector.h"
+#include "precision.h"
+#include "pixel.h"
+#include "aabb.h"
+#include "material.h"
+#include "object.h"
+#include "pool.h"
+#include "accel.h"
+#include "grid.h"
+
+std::ostream& grid_t::put(std::ostream& s) const
+{
+  accel_t::put(s);
+
+  s << ", " << res[0] << "x" << res[1] << "x" << res[2] << " cells, ";
+  s << cells.size() << " refs";
+
+  return s;
+}
+
+int grid_t::clampcell(double p, int axis) const
+{
+	int	c = (int)((p - bounds.min[axis]) * invsize[axis]);
+
+  return c < 0 ? 0 : (c >= res[axis] ? res[axis] - 1 : c);
+}
+
+// 3D-DDA setup: entry cell, distance to the next cell boundary on each
+// axis and distance between boundaries
+void grid_t::setup(const vec_t& pos, const vec_t& dir, const double *inv,
+                   double tenter, int *c, int *step, int *out,
+                   double *tnext, double *delta) const
+{
+  for(int i=0; i<3; i++) {
+    c[i] = clampcell(pos[i] + tenter * dir[i], i);
+    if(dir[i] > 0.0) {
+      step[i] = 1;
+      out[i] = res[i];
+      tnext[i] = (bounds.min[i] + (c[i]+1) * cellsize[i] - pos[i]) * inv[i];
+      delta[i] = cellsize[i] * inv[i];
+    } else if(dir[i] < 0.0) {
+      step[i] = -1;
+      out[i] = -1;
+      tnext[i] = (bounds.min[i] + c[i] * cellsize[i] - pos[i]) * inv[i];
+      delta[i] = -cellsize[i] * inv[i];
+    } else {
+      step[i] = 0;
+      out[i] = -1;
+      tnext[i] = HUGE_VAL;
+      delta[i] = HUGE_VAL;
+    }
+  }
+}
+
+void grid_t::build(const std::vector<object_t* >& objs)
+{
+	std::vector<aabb_t>	boxes(objs.size());
+	vec_t			extent;
+	double			volume = 1.0, k, pad;
+	int			ncells, lo[3], hi[3];
+
+  prims = objs;
+  pool.build(prims);
+  bounds = aabb_t();
+  start.clear();
+  cells.clear();
+  for(int i=0; i<3; i++) res[i] = 1;
+
+  if(prims.empty()) return;
+
+  // scene bounds, padded so flat scenes still have a nonzero extent
+  for(int i=0; i<(int)prims.size(); i++) {
+    prims[i]->getbounds(boxes[i]);
+    bounds.grow(boxes[i]);
+  }
+  extent = bounds.max - bounds.min;
+  pad = 1e-6 * (extent[0] + extent[1] + extent[2] + 1.0);
+  bounds.min = bounds.min - vec_t(pad,pad,pad);
+  bounds.max = bounds.max + vec_t(pad,pad,pad);
+  extent = bounds.max - bounds.min;
+
+  // resolution: about GRID_DENSITY objects per cell, cells roughly cubic
+  for(int i=0; i<3; i++) volume *= extent[i];
+  k = cbrt(GRID_DENSITY * prims.size() / volume);
+  for(int i=0; i<3; i++) {
+    res[i] = (int)(extent[i] * k + 0.5);
+    if(res[i] < 1) res[i] = 1;
+    if(res[i] > GRID_MAX_RES) res[i] = GRID_MAX_RES;
+    cellsize[i] = extent[i] / res[i];
+    invsize[i] = 1.0 / cellsize[i];
+  }
+  ncells = res[0] * res[1] * res[2];
+
+  // two passes: count references per cell, then fill (compact storage)
+  start.assign(ncells + 1, 0);
+  for(int pass=0; pass<2; pass++) {
+	std::vector<int>	fill;
+
+    if(pass == 1) {
+      for(int c=0; c<ncells; c++) start[c+1] += start[c];
+      cells.resize(start[ncells]);
+      fill.assign(start.begin(), start.end() - 1);
+    }
+
+    for(int i=0; i<(int)prims.size(); i++) {
+      for(int a=0; a<3; a++) {
+        lo[a] = clampcell(boxes[i].min[a], a);
+        hi[a] = clampcell(boxes[i].max[a], a);
+      }
+      for(int z=lo[2]; z<=hi[2]; z++)
+        for(int y=lo[1]; y<=hi[1]; y++)
+          for(int x=lo[0]; x<=hi[0]; x++) {
+            if(pass == 0) start[cell(x,y,z) + 1]++;
+            else          cells[fill[cell(x,y,z)]++] = i;
+          }
+    }
+  }
+}
+
+object_t* grid_t::closest(const vec_t& pos, const vec_t& dir,
+                          double& dist) const
+{
+	// candidate object
+	double		c_dist;
+
+	// closest object thus far
+	int		closest_id=-1;
+
+	// traversal state
+	double		inv[3], tenter = 0.0, texit = dist;
+	double		tnext[3], delta[3];
+	int		c[3], step[3], out[3], axis;
+	int		mailbox[GRID_MAILBOX];
+
+  if(prims.empty()) return NULL;
+
+  // clip the ray against the grid bounds
+  for(int i=0; i<3; i++) inv[i] = 1.0 / dir[i];
+  if(!bounds.clip(pos, inv, tenter, texit)) return NULL;
+
+  setup(pos, dir, inv, tenter, c, step, out, tnext, delta);
+
+  for(int i=0; i<GRID_MAILBOX; i++) mailbox[i] = -1;
+
+  while(true) {
+	int	id = cell(c[0],c[1],c[2]);
+
+    // test each object in the cell, skipping ones this ray already tested
+    for(int j=start[id]; j<start[id+1]; j++) {
+	int	i = cells[j];
+
+      if(mailbox[i & (GRID_MAILBOX-1)] == i) continue;
+      mailbox[i & (GRID_MAILBOX-1)] = i;
+
+      // same acceptance test as the linear scan
+      if((c_dist = pool.hits(pos,dir,i)) < 0)
+        continue;
+      else if((HIT_EPS < c_dist) && (c_dist < dist)) {
+        dist = c_dist;
+        closest_id = i;
+      }
+    }
+
+    // step to the neighbouring cell along the axis with the nearest boundary
+    axis = tnext[0] < tnext[1] ? 0 : 1;
+    if(tnext[2] < tnext[axis]) axis = 2;
+
+    // done once the closest hit lies inside the current cell
+    if(dist <= tnext[axis] || tnext[axis] > texit) break;
+
+    c[axis] += step[axis];
+    if(c[axis] == out[axis]) break;
+    tnext[axis] += delta[axis];
+  }
+
+  return(closest_id < 0 ? NULL : pool.getobj(closest_id));
+}
+
+object_t* grid_t::occluded(const vec_t& pos, const vec_t& dir,
+                           double maxdist) const
+{
+	double		c_dist;
+	double		inv[3], tenter = 0.0, texit = maxdist;
+	double		tnext[3], delta[3];
+	int		c[3], step[3], out[3], axis;
+	int		mailbox[GRID_MAILBOX];
+
+  if(prims.empty()) return NULL;
+
+  for(int i=0; i<3; i++) inv[i] = 1.0 / dir[i];
+  if(!bounds.clip(pos, inv, tenter, texit)) return NULL;
+
+  setup(pos, dir, inv, tenter, c, step, out, tnext, delta);
+
+  for(int i=0; i<GRID_MAILBOX; i++) mailbox[i] = -1;
+
+  // same walk as closest(), but any hit short of maxdist ends it
+  while(true) {
+	int	id = cell(c[0],c[1],c[2]);
+
+    for(int j=start[id]; j<start[id+1]; j++) {
+	int	i = cells[j];
+
+      if(mailbox[i & (GRID_MAILBOX-1)] == i) continue;
+      mailbox[i & (GRID_MAILBOX-1)] = i;
+
+      c_dist = pool.hits(pos,dir,i);
+      if((HIT_EPS < c_dist) && (c_dist < maxdist)) return pool.getobj(i);
+    }
+
+    axis = tnext[0] < tnext[1] ? 0 : 1;
+    if(tnext[2] < tnext[axis]) axis = 2;
+
+    if(tnext[axis] > texit) break;
+
+    c[axis] += step[axis];
+    if(c[axis] == out[axis]) break;
+    tnext[axis] += delta[axis];
+  }
+
+  return NULL;
+}
@@ -0,0 +1,85 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <vector>
+
+#define GRID_DENSITY	3.0	// target objects per cell (lambda)
+#define GRID_MAX_RES	128	// max cells per axis
+#define GRID_MAILBOX	32	// per-ray mailbox slots (power of 2)
+
+// uniform grid over the bounded objects of a model; resolution follows
+// the object count and scene bounds, rays walk the cells with a 3D-DDA
+// and a small per-ray mailbox keeps objects spanning several cells from
+// being tested more than once
+class grid_t : public accel_t
+{
+  public:
+  // constructors
+  grid_t() : \
+	accel_t("grid"), \
+	bounds(), \
+	start(), \
+	cells() \
+	{ for(int i=0; i<3; i++) { res[i] = 0; cellsize[i] = invsize[i] = 0.0; } };
+
+  // copy constructor
+  grid_t(const grid_t& rhs) : \
+	accel_t(rhs), \
+	bounds(rhs.bounds), \
+	start(rhs.start), \
+	cells(rhs.cells) \
+	{
+	  for(int i=0; i<3; i++) {
+	    res[i] = rhs.res[i];
+	    cellsize[i] = rhs.cellsize[i];
+	    invsize[i] = rhs.invsize[i];
+	  }
+	}
+
+  // destructors (default ok, objects are owned by the model)
+  ~grid_t()
+	{ };
+
+  // assignment operator
+  const grid_t& operator=(const grid_t& rhs)
+	{
+	  if(this != &rhs) {
+	    accel_t::operator=(rhs);
+	    bounds = rhs.bounds;
+	    start = rhs.start;
+	    cells = rhs.cells;
+	    for(int i=0; i<3; i++) {
+	      res[i] = rhs.res[i];
+	      cellsize[i] = rhs.cellsize[i];
+	      invsize[i] = rhs.invsize[i];
+	    }
+	  }
+          return *this;
+	}
+
+  // members
+  std::ostream&	put(std::ostream& s) const;
+
+  void		build(const std::vector<object_t* >& objs);
+  object_t*	closest(const vec_t& pos, const vec_t& dir,
+		        double& dist) const;
+  object_t*	occluded(const vec_t& pos, const vec_t& dir,
+		         double maxdist) const;
+
+  private:
+  int		cell(int x, int y, int z) const
+			{ return (z * res[1] + y) * res[0] + x; }
+  int		clampcell(double p, int axis) const;
+  void		setup(const vec_t& pos, const vec_t& dir, const double *inv,
+		      double tenter, int *c, int *step, int *out,
+		      double *tnext, double *delta) const;
+
+  aabb_t		bounds;		// grid bounds (all objects)
+  int			res[3];		// cells per axis
+  double		cellsize[3];	// cell size per axis
+  double		invsize[3];	// 1 / cellsize
+  std::vector<int>	start;		// per cell offset into cells, plus end
+  std::vector<int>	cells;		// object indices, cell by cell
+};
+
+#endif
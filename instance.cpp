@@ -0,0 +1,267 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <cmath>
+
+#include "simd.h"
+#include "vector.h"
+#include "pixel.h"
+#include "aabb.h"
+#include "material.h"
+#include "object.h"
+#include "pool.h"
+#include "accel.h"
+#include "bvh.h"
+#include "instance.h"
+
+std::ostream& operator<<(std::ostream& s, const group_t& rhs)
+{
+  assert(rhs.cookie == GRP_COOKIE);
+
+  // print out 'group' token, group name and its members
+  s << "group " << rhs.name.c_str() << std::endl;
+  s << "{" << std::endl;
+  for(int i=0; i<(int)rhs.objs.size(); i++) s << rhs.objs[i];
+  s << "}" << std::endl << std::endl;
+
+  return s;
+}
+
+void group_t::build()
+{
+	aabb_t				box;
+	std::vector<object_t* >		bounded, planes;
+
+  for(int i=0; i<(int)objs.size(); i++) {
+    if(objs[i]->getbounds(box)) bounded.push_back(objs[i]);
+    else                        planes.push_back(objs[i]);
+  }
+  unbounded.build(planes);
+  accel.build(bounded);
+}
+
+bool group_t::getbounds(aabb_t& box) const
+{
+	aabb_t	b;
+
+  // a group with unbounded members is unbounded
+  if(objs.empty() || unbounded.size() > 0) return false;
+
+  box = aabb_t();
+  for(int i=0; i<(int)objs.size(); i++) {
+    objs[i]->getbounds(b);
+    box.grow(b);
+  }
+
+  return true;
+}
+
+object_t* group_t::closest(const vec_t& pos, const vec_t& dir,
+                           double& dist) const
+{
+	object_t	*obj;
+	int		id = -1;
+
+  obj = accel.closest(pos,dir,dist);
+  unbounded.closest(pos,dir,dist,id);
+
+  return(id < 0 ? obj : unbounded.getobj(id));
+}
+
+object_t* group_t::occluded(const vec_t& pos, const vec_t& dir,
+                            double maxdist) const
+{
+	object_t	*obj;
+	int		id;
+
+  if((obj = accel.occluded(pos,dir,maxdist)) != NULL) return obj;
+  if((id = unbounded.any(pos,dir,maxdist)) >= 0) return unbounded.getobj(id);
+
+  return NULL;
+}
+
+std::ostream& instance_t::put(std::ostream& s) const
+{
+  s << type << " " << name << std::endl;
+  s << "{" << std::endl;
+  s << "  group " << group << std::endl;
+  s << "  transform";
+  for(int i=0; i<12; i++) s << " " << fwd[i];
+  s << std::endl;
+  s << "}" << std::endl << std::endl;
+
+  return s;
+}
+
+// transforms apply in the order given: 'scale 2' then 'translate 1 0 0'
+// scales first, then moves
+std::istream& instance_t::get(std::istream& s)
+{
+	char			c;
+	std::string		attrname, line;
+	std::vector<double>	args;
+	double			x, m[12], a, cs, sn, len;
+	vec_t			u;
+
+  s >> name;
+
+  // consume all chars until we get to '{'
+  while(s.good() && s.get(c) && (c != '{'));
+  s >> std::ws;
+
+  // loop until we hit '}'
+  while((c = s.peek()) != '}') {
+
+    // read in attribute name and the rest of the line
+    s >> attrname;
+    std::getline(s, line);
+    s >> std::ws;
+
+    std::istringstream	ls(line);
+    args.clear();
+    if(attrname == "group") { ls >> group; continue; }
+    while(ls >> x) args.push_back(x);
+
+    for(int i=0; i<12; i++) m[i] = (i % 5 == 0) ? 1.0 : 0.0;
+
+    if(attrname == "translate" && args.size() == 3) {
+      m[3] = args[0]; m[7] = args[1]; m[11] = args[2];
+    } else if(attrname == "scale" && args.size() == 1) {
+      m[0] = m[5] = m[10] = args[0];
+    } else if(attrname == "scale" && args.size() == 3) {
+      m[0] = args[0]; m[5] = args[1]; m[10] = args[2];
+    } else if(attrname == "rotate" && args.size() == 4) {
+      // axis x y z, angle in degrees (Rodrigues)
+      u = vec_t(args[0],args[1],args[2]);
+      if((len = u.len()) == 0.0) continue;
+      u = (1.0 / len) * u;
+      a = args[3] * M_PI / 180.0;
+      cs = cos(a);
+      sn = sin(a);
+      for(int i=0; i<3; i++)
+        for(int j=0; j<3; j++)
+          m[4*i+j] = (1.0 - cs) * u[i] * u[j] + (i == j ? cs : 0.0);
+      m[1] -= sn * u[2]; m[4] += sn * u[2];
+      m[2] += sn * u[1]; m[8] -= sn * u[1];
+      m[6] -= sn * u[0]; m[9] += sn * u[0];
+    } else {
+      std::cerr << "instance " << name << ": bad attribute " << attrname;
+      std::cerr << line << std::endl;
+      continue;
+    }
+    apply(m);
+  }
+
+  // eat '}' character
+  while(s.good() && s.get(c) && (c != '}'));
+
+  return s;
+}
+
+void instance_t::identity()
+{
+  for(int i=0; i<12; i++) fwd[i] = inv[i] = (i % 5 == 0) ? 1.0 : 0.0;
+}
+
+// fwd = m * fwd, then recompute the inverse
+void instance_t::apply(const double *m)
+{
+	double	r[12], det;
+
+  for(int i=0; i<3; i++) {
+    for(int j=0; j<4; j++)
+      r[4*i+j] = m[4*i]*fwd[j] + m[4*i+1]*fwd[4+j] + m[4*i+2]*fwd[8+j];
+    r[4*i+3] += m[4*i+3];
+  }
+  for(int i=0; i<12; i++) fwd[i] = r[i];
+
+  // inverse of the 3x3 part (adjugate / det), then of the translation
+  det = fwd[0] * (fwd[5]*fwd[10] - fwd[6]*fwd[9]) -
+        fwd[1] * (fwd[4]*fwd[10] - fwd[6]*fwd[8]) +
+        fwd[2] * (fwd[4]*fwd[9]  - fwd[5]*fwd[8]);
+  if(det == 0.0) {
+    std::cerr << "instance " << name << ": singular transform" << std::endl;
+    identity();
+    return;
+  }
+  inv[0]  =  (fwd[5]*fwd[10] - fwd[6]*fwd[9]) / det;
+  inv[1]  = -(fwd[1]*fwd[10] - fwd[2]*fwd[9]) / det;
+  inv[2]  =  (fwd[1]*fwd[6]  - fwd[2]*fwd[5]) / det;
+  inv[4]  = -(fwd[4]*fwd[10] - fwd[6]*fwd[8]) / det;
+  inv[5]  =  (fwd[0]*fwd[10] - fwd[2]*fwd[8]) / det;
+  inv[6]  = -(fwd[0]*fwd[6]  - fwd[2]*fwd[4]) / det;
+  inv[8]  =  (fwd[4]*fwd[9]  - fwd[5]*fwd[8]) / det;
+  inv[9]  = -(fwd[0]*fwd[9]  - fwd[1]*fwd[8]) / det;
+  inv[10] =  (fwd[0]*fwd[5]  - fwd[1]*fwd[4]) / det;
+  for(int i=0; i<3; i++)
+    inv[4*i+3] = -(inv[4*i]*fwd[3] + inv[4*i+1]*fwd[7] + inv[4*i+2]*fwd[11]);
+}
+
+vec_t instance_t::topoint(const double *m, const vec_t& p) const
+{
+  return vec_t(m[0]*p[0] + m[1]*p[1] + m[2]*p[2]  + m[3],
+               m[4]*p[0] + m[5]*p[1] + m[6]*p[2]  + m[7],
+               m[8]*p[0] + m[9]*p[1] + m[10]*p[2] + m[11]);
+}
+
+vec_t instance_t::todir(const double *m, const vec_t& d) const
+{
+  return vec_t(m[0]*d[0] + m[1]*d[1] + m[2]*d[2],
+               m[4]*d[0] + m[5]*d[1] + m[6]*d[2],
+               m[8]*d[0] + m[9]*d[1] + m[10]*d[2]);
+}
+
+double	instance_t::hits(const vec_t& pos, const vec_t& dir)
+{
+	double	dist = HUGE_VAL;
+
+  assert(cookie == OBJ_COOKIE);
+
+  if(!grp) return(-1);
+
+  // the local ray has the same parameterization as the world ray
+  if(!grp->closest(topoint(inv,pos), todir(inv,dir), dist)) return(-1);
+
+  return(dist);
+}
+
+object_t* instance_t::surface(const vec_t& pos, const vec_t& dir, double t,
+                              vec_t& hit, vec_t& N)
+{
+	vec_t		lpos = topoint(inv,pos), ldir = todir(inv,dir);
+	vec_t		lhit, lN;
+	double		dist = HUGE_VAL;
+	object_t	*leaf;
+
+  hit = pos + t * dir;
+
+  // find the member hit again, it supplies the normal and material; if
+  // it can't be found (numerically) there is no surface, the ray misses
+  if(!grp || !(leaf = grp->closest(lpos, ldir, dist))) return NULL;
+  leaf = leaf->surface(lpos, ldir, dist, lhit, lN);
+
+  // normals go back to world space by the inverse transpose
+  N = vec_t(inv[0]*lN[0] + inv[4]*lN[1] + inv[8]*lN[2],
+            inv[1]*lN[0] + inv[5]*lN[1] + inv[9]*lN[2],
+            inv[2]*lN[0] + inv[6]*lN[1] + inv[10]*lN[2]).norm();
+
+  return leaf;
+}
+
+bool	instance_t::getbounds(aabb_t& box)
+{
+	aabb_t	local;
+
+  if(!grp || !grp->getbounds(local)) return false;
+
+  // world box around the transformed corners of the local one
+  box = aabb_t();
+  for(int i=0; i<8; i++)
+    box.grow(topoint(fwd, vec_t(i & 1 ? local.max[0] : local.min[0],
+                                i & 2 ? local.max[1] : local.min[1],
+                                i & 4 ? local.max[2] : local.min[2])));
+
+  return true;
+}
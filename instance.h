@@ -0,0 +1,123 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include <vector>
+
+#define GRP_COOKIE 60217733
+
+// named set of objects that is never rendered itself, only through
+// instances; it keeps its own acceleration structure (built once, shared
+// by all instances) in the group's local coordinates
+class group_t
+{
+  public:
+  // constructors
+  group_t() : \
+	cookie(GRP_COOKIE), \
+	name(), \
+	objs(), \
+	accel(), \
+	unbounded() \
+	{ };
+
+  // copy constructor (default member copies ok)
+  // destructors (default ok, objects are owned by the group)
+
+  // friends
+  friend std::ostream& operator<<(std::ostream& s, const group_t& rhs);
+  friend std::ostream& operator<<(std::ostream& s, group_t *rhs)
+		{ return(s << (*rhs)); }
+
+  // methods
+  int		getcookie()	{ return cookie; }
+  std::string	getname()	{ return name; }
+  void		setname(const std::string& iname)	{ name = iname; }
+  int		size() const	{ return (int)objs.size(); }
+  object_t*	getmember(int i) const	{ return objs[i]; }
+
+  void		add(object_t *obj)	{ objs.push_back(obj); }
+  void		build();
+
+  // same queries as the model's, in local coordinates
+  bool		getbounds(aabb_t& box) const;
+  object_t*	closest(const vec_t& pos, const vec_t& dir,
+		        double& dist) const;
+  object_t*	occluded(const vec_t& pos, const vec_t& dir,
+		         double maxdist) const;
+
+  private:
+  int				cookie;		// magic number
+  std::string			name;		// name
+  std::vector<object_t* >	objs;		// members, in scene order
+  bvh_t				accel;		// bounded members
+  planes_t			unbounded;	// e.g., planes
+};
+
+// a group placed in the scene with an affine transform; rays are taken to
+// the group's local space at intersection time (the ray parameter t is
+// the same in both spaces, local directions are not renormalized) so any
+// number of instances share one copy of the geometry. the material of a
+// hit is the one of the group member hit
+class instance_t : public object_t
+{
+  public:
+  // constructors (overloaded)
+  instance_t(std::string token) : \
+        object_t(token), \
+	group(), \
+	grp(NULL) \
+	{ identity(); };
+
+  // copy constructor
+  instance_t(const instance_t& rhs) : \
+        object_t(rhs), \
+	group(rhs.group), \
+	grp(rhs.grp) \
+	{ for(int i=0; i<12; i++) { fwd[i] = rhs.fwd[i]; inv[i] = rhs.inv[i]; } };
+
+  // destructors (default ok, the group is owned by the model)
+  ~instance_t()
+	{ };
+
+  // operators (incl. assignment operator)
+  const instance_t& operator=(const instance_t& rhs)
+	{
+	  if(this != &rhs) {
+	    cookie = rhs.cookie;
+	    type = rhs.type;
+	    name = rhs.name;
+	    material = rhs.material;
+	    mat = rhs.mat;
+	    group = rhs.group;
+	    grp = rhs.grp;
+	    for(int i=0; i<12; i++) { fwd[i] = rhs.fwd[i]; inv[i] = rhs.inv[i]; }
+	  }
+          return *this;
+	}
+
+  // friends
+  std::ostream& put(std::ostream& s) const;
+  std::istream& get(std::istream& s);
+
+  // methods
+  std::string	getgroup()		{ return group; }
+  void		setgroup(group_t *igrp)	{ grp = igrp; }
+
+  double	hits(const vec_t&, const vec_t&);
+  object_t*	surface(const vec_t& pos, const vec_t& dir, double t,
+			vec_t& hit, vec_t& N);
+  bool		getbounds(aabb_t&);
+
+  private:
+  void		identity();
+  void		apply(const double *m);		// fwd = m * fwd
+  vec_t		topoint(const double *m, const vec_t& p) const;
+  vec_t		todir(const double *m, const vec_t& d) const;
+
+  std::string	group;		// group name
+  group_t	*grp;		// resolved at load
+  double	fwd[12];	// local to world, 3x4 row major
+  double	inv[12];	// world to local
+};
+
+#endif
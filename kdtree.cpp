@@ -4,14 +4,23 @@
 #include <algorithm>
 #include <cmath>
 
+#include "simd.h"
 #include "vector.h"
 #include "pixel.h"
+#include "aabb.h"
 #include "camera.h"
+#include "options.h"
 #include "light.h"
 #include "material.h"
 #include "object.h"
 #include "list.h"
 #include "plane.h"
+#include "pool.h"
+#include "accel.h"
+#include "bvh.h"
+#include "grid.h"
+#include "tiles.h"
+#include "lightgrid.h"
 #include "model.h"
 #include "ray.h"
 #include "timer.h"
@@ -28,236 +37,239 @@
 		if(rhs.empty())
 			{ s << "tree is empty" << std::endl; }
 		else
-			{ s << rhs.root; }
+			{ rhs.print(s, 1); }
 		return s;
 	}
 
-	// deletes the entire tree through recursion, by deleting the left and right
-	// nodes of each node before deleteing the actual node, starting from the root
+	// outputs the subtree at node i in order
 	template <typename T, typename P, typename C>
-	void kdtree_t<T,P,C>::clear(kdnode_t* &t)
+	void kdtree_t<T,P,C>::print(std::ostream& s, int i) const
 	{
-		if(t != NULL)
-		{
-			clear(t->left);
-			clear(t->right);
-			delete t;
-		}
-		t = NULL;
-	}
+		if(i >= (int)nodes.size())	{ return; }
 
-	// clones tree by recurrisvely cloning the left and right subtrees of the passed node
-	template <typename T, typename P, typename C>
-	typename kdtree_t<T,P,C>::kdnode_t* kdtree_t<T,P,C>::clone(kdnode_t* nod) const
-	{
-		if(nod == NULL)	{ return NULL; }
-		return( new kdnode_t(nod->data, nod->min, nod->max, clone(nod->left), clone(nod->right), nod->axis) );
+		print(s, 2 * i);
+		s << nodes[i];
+		s << std::endl;
+		print(s, 2 * i + 1);
 	}
 
+	// builds the tree, all the nodes in one array; the top call starts the
+	// threads, the subtrees are tasks any of them can take
 	template <typename T, typename P, typename C>
-	typename kdtree_t<T,P,C>::kdnode_t* kdtree_t<T,P,C>::insert(std::vector<P>& x, const T& min, const T& max, int d)
+	void kdtree_t<T,P,C>::insert(std::vector<P>& x)
 	{
-		int					axis = x.empty() ? 0 : d % x[0]->dim();
-		int					m = 0; // the index for the median
-		P					median;
-		T					_min, _max; // bounding values of subspaces
-		std::vector<P>				left, right;
-		typename std::vector<P>::iterator 	itr;
-
-		// return if there are no points in the vector
-		if(x.empty()) { return(NULL); }
+		nodes.clear();
+		if(x.empty()) { return; }
 
-		// debugging
-		std::cerr << "depth: " << d << std::endl;
-		std::cerr << "size: " << x.size() << std::endl;
+		nodes.resize(x.size() + 1);
 
-		// sort the vector of points to obtain the median
-		sort(x.begin(), x.end(), C(axis));
+		#pragma omp parallel
+		#pragma omp single
+		insert(x, 0, (int)x.size(), 1);
+	}
 
-		// debugging
-		for(itr = x.begin(); itr < x.end(); itr++)  { std::cerr << (**itr) << std::endl; }
+	// puts the points x[lo] .. x[hi-1] in the subtree at node i: the median
+	// along the axis they spread furthest on goes in node i, the points
+	// before it in the left subtree and those after it in the right one.
+	// the range is only partitioned around the median (nth_element), in
+	// place, so a level costs O(n) and the build O(n log n)
+	template <typename T, typename P, typename C>
+	void kdtree_t<T,P,C>::insert(std::vector<P>& x, int lo, int hi, int i)
+	{
+		int		n = hi - lo;
+		int		axis = 0;
+		int		m = 0; // the index for the median
+		int		full, last;
+		double		spread = -1.0, amin, amax;
 
-		// get actual median
-		m = x.size() / 2;
+		// return if there are no points in the range
+		if(n <= 0) { return; }
 
-		// create left and right subtrees
-		for(int i = 0; i < (int)x.size(); i++)
+		// split on the axis of largest extent
+		for(int a = 0; a < x[lo].dim(); a++)
 		{
-			if(i < m)	{ left.push_back(x[i]); }
-			else if(i > m)	{ right.push_back(x[i]); }
-			else		{ median = x[m]; }
+			amin = amax = x[lo][a];
+			for(int k = lo + 1; k < hi; k++)
+			{
+				amin = std::min(amin, (double)x[k][a]);
+				amax = std::max(amax, (double)x[k][a]);
+			}
+			if(amax - amin > spread) { spread = amax - amin; axis = a; }
 		}
 
-		// create a new node
-		kdnode_t* node = new kdnode_t(median, min, max, NULL, NULL, axis);
+		// the median is not the middle point but the one that leaves the left
+		// subtree as many points as it holds in a left balanced tree of n:
+		// half the full levels, plus as much of the last level as fits
+		for(full = 1; 2 * full + 1 <= n; full = 2 * full + 1);
+		last = n - full;
+		m = (full - 1) / 2 + std::min(last, (full + 1) / 2);
 
-		// recursively add the left subtree
-		_min = min;
-		_max = max;
-		_max[axis] = (*median)[axis];
-		node->left = insert(left, _min, _max, (d + 1));
+		// smaller points before it, larger after it, along the axis
+		nth_element(x.begin() + lo, x.begin() + lo + m, x.begin() + hi, C(axis));
 
-		// recursively add the right subtree
-		_min = min;
-		_max = max;
-		_max[axis] = (*median)[axis];
-		node->right = insert(right, _min, _max, (d + 1));
+		nodes[i] = x[lo + m];
+		nodes[i].setaxis(axis);
 
-		return(node);
-		
+		// recursively add the left and right subtrees, a big left one as a
+		// task (the parallel region's end waits for them all)
+		#pragma omp task shared(x) if(m >= KD_TASK)
+		insert(x, lo, lo + m, 2 * i);
+		insert(x, lo + m + 1, hi, 2 * i + 1);
 	}
 
-	// find the nearest point to a point passed in the parameters
+	// the k nearest points: a descent goes to the leaf on center's side of
+	// each split, pushing the far child with the squared distance to the
+	// split; a pushed child is skipped once that is no longer inside the
+	// search radius, which shrinks to the heap's furthest point once it
+	// holds k
 	template <typename T, typename P, typename C>
-	void kdtree_t<T,P,C>::nn(kdnode_t* &nod, T& center, P& pt, double& radius)
+	int kdtree_t<T,P,C>::knn(const T& center, const P **pt, double *d2, int k, double& radius) const
 	{
-		double	dist;
-		int	axis;
+		const P		*nod;
+		int		node[KD_STACK];
+		double		plane[KD_STACK];
+		int		top = 0, n = 0, i, c, j, axis, near, far;
+		double		max2 = radius * radius, d, p;
 
-		if(nod == NULL)	{ return; }
+		if(k <= 0 || empty())	{ return 0; }
 
-		// determine the node's distance to the point passed as a parameter
-		dist = center.distance(nod->data);
-
-		if(dist < radius)
+		node[top] = 1;
+		plane[top++] = 0.0;
+		while(top > 0)
 		{
-			radius = dist;
-			pt = nod->data;
-		}
+			top--;
+			if(plane[top] >= max2)	{ continue; }
 
-		// traverse down "closer" side of the tree
-		// testing each encountered node as we move
-		// down the tree the recursive calls will
-		// override the pt and radius arguments
-		// if a closer node than the current node is found
-		//
-		// also need to check to see if the current closest
-		// circle defined by the center and radius variables
-		// intersects the other side of the tree in which
-		// case we must search that subtree
-		axis = nod->axis;
-		if(center[axis] <= (*nod->data)[axis])
-		{
-			nn(nod->left, center, pt, radius);
-			if((center[axis] + radius) > (*nod->data)[axis])
-				{  nn(nod->right, center, pt, radius); }
-		}
-		else
-		{
-			nn(nod->right, center, pt, radius);
-			if((center[axis] - radius) >= (*nod->data)[axis])
-				{ nn(nod->left, center, pt, radius); }		
+			for(i = node[top]; i < (int)nodes.size(); i = near)
+			{
+				nod = &nodes[i];
+				d = center.distance2(*nod);
+
+				if(d < max2)
+				{
+					// not full: add at the bottom of the heap and sift up
+					if(n < k)
+					{
+						for(c = n++; c > 0 && d2[(c - 1) / 2] < d; c = (c - 1) / 2)
+							{ pt[c] = pt[(c - 1) / 2]; d2[c] = d2[(c - 1) / 2]; }
+						pt[c] = nod;
+						d2[c] = d;
+					}
+					// full: replace the furthest (the top) and sift down
+					else
+					{
+						for(c = 0; 2 * c + 1 < n; c = j)
+						{
+							j = 2 * c + 1;
+							if(j + 1 < n && d2[j + 1] > d2[j])	{ j++; }
+							if(d2[j] <= d)				{ break; }
+							pt[c] = pt[j];
+							d2[c] = d2[j];
+						}
+						pt[c] = nod;
+						d2[c] = d;
+					}
+					if(n == k)	{ max2 = d2[0]; }
+				}
+
+				axis = nod->getaxis();
+				p = center[axis] - (*nod)[axis];
+				near = p <= 0.0 ? 2 * i : 2 * i + 1;
+				far = p <= 0.0 ? 2 * i + 1 : 2 * i;
+				if(far < (int)nodes.size() && p * p < max2)
+				{
+					node[top] = far;
+					plane[top++] = p * p;
+				}
+			}
 		}
+
+		if(n > 0)	{ radius = sqrt(d2[0]); }
+		return n;
 	}
 
-	// find k nearest points to the point passed as a parameter
+	// the points within radius, same walk with a fixed radius
 	template <typename T, typename P, typename C>
-	void kdtree_t<T,P,C>::knn(kdnode_t* &nod, T& center, std::vector<P>& pt, double& radius, int k)
+	int kdtree_t<T,P,C>::within(const T& center, double radius, const P **pt, int max) const
 	{
-		double					dist;
-		int					axis;
-		typename std::vector<P>::iterator	pitr;
+		const P		*nod;
+		int		node[KD_STACK];
+		double		plane[KD_STACK];
+		int		top = 0, n = 0, i, axis, near, far;
+		double		max2 = radius * radius, p;
 
-		if(nod == NULL)	{ return; }
+		if(empty())	{ return 0; }
 
-		// determine the node's distance to the point that is passed as a parameter
-		dist = center.distance(nod->data);
-
-		// instead of searching a set raduis, search a radius
-		// of infinity until k points are found
-		if((int)pt.size() < k)
+		node[top] = 1;
+		plane[top++] = 0.0;
+		while(top > 0)
 		{
-			// if the list is empty or the distance
-			// is larger than last node add the node to the end
-			if(pt.empty() || (dist > center.distance( pt.back())))
-				{ pt.push_back(nod->data); }
-			// else iterate through the list to find proper place to insert the point
-			else
+			top--;
+			if(plane[top] > max2)	{ continue; }
+
+			for(i = node[top]; i < (int)nodes.size(); i = near)
 			{
-				for(pitr = pt.begin(); pitr != pt.end(); pitr++)
+				nod = &nodes[i];
+				if(center.distance2(*nod) <= max2)
 				{
-					if(dist < center.distance(*pitr))
-						{ pt.insert(pitr, 1, nod->data); break; }
+					if(n < max)	{ pt[n] = nod; }
+					n++;
 				}
-			}
-		}
-		// else insert the current node into the list of closest points
-		// checking its distance compared to points that are in the list
-		// insert the point only if the distance is smaller than the 
-		// last point on the list if it isn't just ignore the point
-		else
-		{
-			if(dist < center.distance( pt.back()))
-			{
-				for(pitr = pt.begin(); pitr != pt.end(); pitr++)
+
+				axis = nod->getaxis();
+				p = center[axis] - (*nod)[axis];
+				near = p <= 0.0 ? 2 * i : 2 * i + 1;
+				far = p <= 0.0 ? 2 * i + 1 : 2 * i;
+				if(far < (int)nodes.size() && p * p <= max2)
 				{
-					if(dist < center.distance(*pitr))
-						{ pt.insert(pitr, 1, nod->data); break; }
+					node[top] = far;
+					plane[top++] = p * p;
 				}
 			}
-			// since we already have k total points and have added
-			// one node we only need to pop one point off of the
-			// back of the list of points
-			if((int)pt.size() > k)	{ pt.pop_back(); }
-		}
-
-		// find the largest distance in the list of points
-		radius = center.distance(pt.back());
-
-		// exact same algorithm as nn except recursievly run knn instead of nn
-		axis = nod->axis;
-		if(center[axis] <= (*nod->data)[axis])
-		{
-			knn(nod->left, center, pt, radius, k);
-			if((center[axis] + radius) > (*nod->data)[axis])
-				{  knn(nod->right, center, pt, radius, k); }
-		}
-		else
-		{
-			knn(nod->right, center, pt, radius, k);
-			if((center[axis] - radius) >= (*nod->data)[axis])
-				{ knn(nod->left, center, pt, radius, k); }		
 		}
 
+		return n;
 	}
 
 	template <typename T, typename P, typename C>
-	void kdtree_t<T,P,C>::range(kdnode_t* &nod, const T& min, const T& max, std::vector<P>& pt)
+	void kdtree_t<T,P,C>::range(int i, const T& min, const T& max, std::vector<const P*>& pt) const
 	{
-		bool	truth_value;
+		const P		*nod;
+		bool		truth_value = true;
 
-		if(nod == NULL)	{ return; }
+		if(i >= (int)nodes.size())	{ return; }
+		nod = &nodes[i];
 
 		// checks to see if the data is in the range
-		for(int i = 0; i < (nod->data->dim()); i++)
+		for(int a = 0; a < (nod->dim()); a++)
 		{
-			if(((*nod->data)[i] < min[i]) || ((*nod->data)[i] > max[i]))
+			if(((*nod)[a] < min[a]) || ((*nod)[a] > max[a]))
 				{ truth_value = false; break; }
 		}
 
 		// if data is in range it is added to the list
-		if(truth_value == true)		{ pt.push_back(nod->data); }
+		if(truth_value == true)		{ pt.push_back(nod); }
 
 		// the range is on both sides of the tree
-		if(	((*nod->data)[nod->axis] >= min[nod->axis]) &&
-			((*nod->data)[nod->axis] <= max[nod->axis])	)
+		if(	((*nod)[nod->getaxis()] >= min[nod->getaxis()]) &&
+			((*nod)[nod->getaxis()] <= max[nod->getaxis()])	)
 		{
-			range(nod->left,min,max,pt);
-			range(nod->right,min,max,pt);
+			range(2 * i,min,max,pt);
+			range(2 * i + 1,min,max,pt);
 		}
 
 		// the range is all smaller and can be placed completely on the left of the tree
-		else if((*nod->data)[nod->axis] >= max[nod->axis])
-			{ range(nod->left,min,max,pt); }
+		else if((*nod)[nod->getaxis()] >= max[nod->getaxis()])
+			{ range(2 * i,min,max,pt); }
 
 		// the range is all larger and can be placed completely on the right of the tree
-		else if((*nod->data)[nod->axis] <= min[nod->axis])
-			{ range(nod->right,min,max,pt); }
+		else if((*nod)[nod->getaxis()] <= min[nod->getaxis()])
+			{ range(2 * i + 1,min,max,pt); }
 	}
 
 
 	///////// specializations //////////
-	template class kdtree_t<photon_t, photon_t*, photon_c>;	
-	template std::ostream& operator<<(std::ostream&, const kdtree_t<photon_t, photon_t*, photon_c>&);
+	template class kdtree_t<photonrec_t, photonrec_t, photonrec_c>;	
+	template std::ostream& operator<<(std::ostream&, const kdtree_t<photonrec_t, photonrec_t, photonrec_c>&);
 
 
@@ -5,6 +5,9 @@
 #define INFINITY MAXFLOAT
 #endif
 
+#define KD_STACK	64	// query stack, deeper than any tree
+#define KD_TASK		4096	// build: subtrees at least this big are tasks
+
 
 // forward declarations
 template <typename T, typename P, typename C> class kdtree_t;
@@ -13,59 +16,19 @@ template <typename T, typename P, typename C>
 
 template <typename T, typename P, typename C>
 
+// a kd tree of points P, stored by value, one point per node; a point
+// holds the axis its subtree is split on (getaxis/setaxis). queries are
+// centered on a T, C(axis) orders points along an axis
 class kdtree_t
 {
-	private:
-
-////////// Node /////////////////////
-	struct kdnode_t
-	{
-		P        	data;
-		T		min, max;
-		kdnode_t	*left, *right;
-		int		axis;
-
-		kdnode_t(const P& dat = P(), const T& inmin = T(), const T& inmax = T(),
-			kdnode_t *l = NULL, kdnode_t *r = NULL, int x = 0) : \
-				data(dat), min(inmin), max(inmax), left(l), right(r), axis(x) \
-									{ };
-
-		// output stream operators of node
-		friend std::ostream& operator<<(std::ostream &s, const kdnode_t& rhs)
-		{
-			s << rhs.left;
-			s << rhs.data;
-			s << std::endl;
-			s << rhs.right;
-			return(s);
-		}
-
-		friend std::ostream& operator<<(std::ostream &s, kdnode_t *rhs)
-		{ 
-			if(rhs) 	{ return(s << (*rhs)); }
-			else		{return(s); }
-		}
-	};
-////////////////////////////////////
-
 	public:
 
 	// constructors
-	kdtree_t()	{ root = NULL; };
-
-	// destructors
-	~kdtree_t()	{ clear(); };
-
-	// assignment operator
-	kdtree_t operator=(const kdtree_t& rhs)
-	{
-		if(this != &rhs)
-		{
-			clear();		
-			root = clone(rhs.root);
-		}
-		return(*this);
-	}
+	kdtree_t() : \
+		nodes() \
+		{ };
+
+	// destructors (default ok, no 'new' in constructor)
 
 	// output stream operators
 	friend std::ostream& operator<< <>(std::ostream& s, const kdtree_t& rhs);
@@ -76,37 +39,63 @@ class kdtree_t
 	
 	// checks to see if the tree is empty
 	bool		empty() const
-				{ return root == NULL ? true : false; }
+				{ return nodes.size() <= 1; }
+
+	// number of points in the tree
+	int		size() const
+				{ return nodes.empty() ? 0 : (int)nodes.size() - 1; }
 
-	// inserts a point into the kd tree
-	kdnode_t*	insert(std::vector<P>& pt, const T& min, const T& max)
-				{ root = insert(pt, min, max, 0); }
+	// the points, 0 .. size()-1, in tree order
+	const P&	operator[](int i) const
+				{ return nodes[i + 1]; }
+
+	// builds the tree from a vector of points (reordered in place, the
+	// tree keeps copies), the subtrees in parallel
+	void		insert(std::vector<P>& pt);
+
+	// the queries don't change the tree, any number of threads can run
+	// them at once on the one (const) tree
+
+	// the point queries keep squared distances and walk the tree with a
+	// stack of their own, the caller provides the storage for the results
+	// (pointers into the tree); they allocate nothing
 
 	// finds the nearest neighbor to a given point (pt)
-	void		nn(T& center, P& pt, double& radius)
-				{ radius = INFINITY; nn(root, center, pt, radius); }
+	void		nn(const T& center, const P*& pt, double& radius) const
+				{ double d2; radius = INFINITY; knn(center, &pt, &d2, 1, radius); }
 
-	// finds k nearest neighbors to a given point (pt)
-	void		knn(T& center, std::vector<P> pt, double& radius, int k)
-				{ radius = INFINITY; knn(root, center, pt, radius, k); }
+	// finds the (up to) k nearest neighbors of center no further than
+	// radius, into pt[] with their squared distances in d2[], as a max
+	// heap (the furthest first); returns how many, radius is set to the
+	// distance of the furthest (untouched if none)
+	int		knn(const T& center, const P **pt, double *d2, int k, double& radius) const;
+
+	// finds the points no further than radius from center, the first max
+	// of them into pt[]; returns how many there are
+	int		within(const T& center, double radius, const P **pt, int max) const;
 
 	// creates a list of data that is within the min and max passed by the function
-	void		range(const T& min, const T& max, std::vector<P>& pt)
-				{ range(root, min, max, pt); }
+	void		range(const T& min, const T& max, std::vector<const P*>& pt) const
+				{ range(1, min, max, pt); }
 
 	// clears the entire kd tree
-	void		clear()		{ clear(root); }
+	void		clear()		{ nodes.clear(); }
 
 	private:
 
-	kdnode_t	*root;
+	// the nodes in heap order, left balanced (filled level by level, the
+	// last level from the left), all in one array: the children of node i
+	// are nodes 2i and 2i+1 (those past the end don't exist), so there are
+	// no links to store or chase. nodes[0] is unused so the root is 1
+	std::vector<P>	nodes;
+
+	// not copyable: the photon map is built once and shared by reference
+	kdtree_t(const kdtree_t&);
+	kdtree_t&	operator=(const kdtree_t&);
 
-	kdnode_t*	insert(std::vector<P>&, const T&, const T&, int);
-	void		nn(kdnode_t* &, T&, P&, double&);
-	void		knn(kdnode_t* &, T&, std::vector<P>&, double&, int);
-	void		range(kdnode_t* &, const T&, const T&, std::vector<P>&);
-	void		clear(kdnode_t* &);
-	kdnode_t*	clone(kdnode_t* ) const;
+	void		insert(std::vector<P>&, int, int, int);
+	void		range(int, const T&, const T&, std::vector<const P*>&) const;
+	void		print(std::ostream&, int) const;
 
 };
 
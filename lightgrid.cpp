@@ -0,0 +1,139 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "simd.h"
+#include "vector.h"
+#include "pixel.h"
+#include "aabb.h"
+#include "light.h"
+#include "lightgrid.h"
+
+std::ostream& operator<<(std::ostream& s, const lightgrid_t& rhs)
+{
+  s << "lights: " << rhs.size();
+  if(rhs.threshold > 0.0) {
+    s << ", cull " << rhs.threshold << ", ";
+    s << rhs.res[0] << "x" << rhs.res[1] << "x" << rhs.res[2] << " cells, ";
+    s << rhs.cells.size() << " refs";
+  }
+
+  return s;
+}
+
+void lightgrid_t::build(const std::vector<light_t* >& lgts, double ithreshold)
+{
+	std::vector<double>	reach;
+	vec_t			extent, p;
+	double			volume = 1.0, k, pad, d, e, lo_a, cellsize[3];
+	int			ncells, lo[3], hi[3];
+
+  threshold = ithreshold;
+  loc.clear();
+  color.clear();
+  bright.clear();
+  all.clear();
+  bounds = aabb_t();
+  start.clear();
+  cells.clear();
+  for(int i=0; i<3; i++) res[i] = 1;
+
+  for(int i=0; i<(int)lgts.size(); i++) {
+    loc.push_back(lgts[i]->getlocation());
+    color.push_back(lgts[i]->getcolor());
+    bright.push_back(fmax(color[i][0], fmax(color[i][1], color[i][2])));
+    all.push_back(i);
+  }
+
+  if(threshold <= 0.0 || loc.empty()) return;
+
+  // sphere of influence of each light, the grid bounds enclose them all
+  // (padded, so rounding can't drop a light from a cell it reaches)
+  for(int i=0; i<size(); i++) {
+    reach.push_back(bright[i] / threshold);
+    bounds.grow(loc[i] - vec_t(reach[i],reach[i],reach[i]));
+    bounds.grow(loc[i] + vec_t(reach[i],reach[i],reach[i]));
+  }
+  extent = bounds.max - bounds.min;
+  pad = 1e-6 * (extent[0] + extent[1] + extent[2] + 1.0);
+  bounds.min = bounds.min - vec_t(pad,pad,pad);
+  bounds.max = bounds.max + vec_t(pad,pad,pad);
+  extent = bounds.max - bounds.min;
+
+  // resolution: about one light per cell, cells roughly cubic
+  for(int i=0; i<3; i++) volume *= extent[i];
+  k = cbrt(size() / volume);
+  for(int i=0; i<3; i++) {
+    res[i] = (int)(extent[i] * k + 0.5);
+    if(res[i] < 1) res[i] = 1;
+    if(res[i] > LGRID_MAX_RES) res[i] = LGRID_MAX_RES;
+    cellsize[i] = extent[i] / res[i];
+    invsize[i] = 1.0 / cellsize[i];
+  }
+  ncells = res[0] * res[1] * res[2];
+
+  // two passes: count references per cell, then fill (compact storage);
+  // a light goes in every cell its sphere touches, in light order
+  start.assign(ncells + 1, 0);
+  for(int pass=0; pass<2; pass++) {
+	std::vector<int>	fill;
+
+    if(pass == 1) {
+      for(int c=0; c<ncells; c++) start[c+1] += start[c];
+      cells.resize(start[ncells]);
+      fill.assign(start.begin(), start.end() - 1);
+    }
+
+    for(int i=0; i<size(); i++) {
+      for(int a=0; a<3; a++) {
+        lo[a] = (int)((loc[i][a] - reach[i] - bounds.min[a]) * invsize[a]);
+        hi[a] = (int)((loc[i][a] + reach[i] - bounds.min[a]) * invsize[a]);
+        if(lo[a] < 0) lo[a] = 0;
+        if(hi[a] >= res[a]) hi[a] = res[a] - 1;
+      }
+      for(int z=lo[2]; z<=hi[2]; z++)
+        for(int y=lo[1]; y<=hi[1]; y++)
+          for(int x=lo[0]; x<=hi[0]; x++) {
+            // distance from the light to the cell box
+            p = vec_t(x,y,z);
+            d = 0.0;
+            for(int a=0; a<3; a++) {
+              lo_a = bounds.min[a] + p[a] * cellsize[a];
+              e = fmax(lo_a - loc[i][a], loc[i][a] - (lo_a + cellsize[a]));
+              if(e > 0.0) d += e * e;
+            }
+            if(d > (reach[i] + pad) * (reach[i] + pad)) continue;
+
+            if(pass == 0) start[cell(x,y,z) + 1]++;
+            else          cells[fill[cell(x,y,z)]++] = i;
+          }
+    }
+  }
+}
+
+int lightgrid_t::lookup(const vec_t& p, const int *&idx) const
+{
+	int	c[3], id;
+
+  if(loc.empty()) return 0;
+
+  // no culling: every light
+  if(threshold <= 0.0) {
+    idx = &all[0];
+    return size();
+  }
+
+  // outside the grid no light counts
+  if(cells.empty()) return 0;
+  for(int a=0; a<3; a++) {
+    if(p[a] < bounds.min[a] || p[a] > bounds.max[a]) return 0;
+    c[a] = (int)((p[a] - bounds.min[a]) * invsize[a]);
+    if(c[a] >= res[a]) c[a] = res[a] - 1;
+  }
+
+  id = cell(c[0],c[1],c[2]);
+  idx = &cells[0] + start[id];
+
+  return start[id+1] - start[id];
+}
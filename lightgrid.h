@@ -0,0 +1,65 @@
+#ifndef LIGHTGRID_H
+#define LIGHTGRID_H
+
+#include <vector>
+
+#define LGRID_MAX_RES	32	// max cells per axis
+
+// the scene's lights in contiguous arrays (location, color), for the
+// shading loop. with a cull threshold t > 0 a light of color c only
+// counts where max(c) / r >= t, i.e. within r = max(c) / t of it, and a
+// uniform grid over those spheres lists the lights that can count in each
+// cell; a hit point then only looks at the lights of its cell (and none
+// outside the grid)
+class lightgrid_t
+{
+  public:
+  // constructors
+  lightgrid_t() : \
+	threshold(0.0), \
+	loc(), \
+	color(), \
+	bright(), \
+	all(), \
+	bounds(), \
+	start(), \
+	cells() \
+	{ for(int i=0; i<3; i++) { res[i] = 0; invsize[i] = 0.0; } };
+
+  // copy constructor (default member copies ok)
+  // destructors (default ok, no 'new' in constructor)
+
+  // friends
+  friend std::ostream& operator<<(std::ostream& s, const lightgrid_t& rhs);
+
+  // methods
+  int			size() const	{ return (int)loc.size(); }
+  const vec_t&		getlocation(int i) const	{ return loc[i]; }
+  const rgb_t<double>&	getcolor(int i) const		{ return color[i]; }
+
+  // true if light i doesn't count at distance r
+  bool			culled(int i, double r) const
+				{ return bright[i] < threshold * r; }
+
+  void			build(const std::vector<light_t* >& lgts, double ithreshold);
+
+  // lights that may count at p: sets idx to their indices, returns how many
+  int			lookup(const vec_t& p, const int *&idx) const;
+
+  private:
+  int		cell(int x, int y, int z) const
+			{ return (z * res[1] + y) * res[0] + x; }
+
+  double			threshold;	// cull threshold, 0: off
+  std::vector<vec_t>		loc;		// light locations
+  std::vector<rgb_t<double> >	color;		// light colors
+  std::vector<double>		bright;		// max color component
+  std::vector<int>		all;		// 0 .. size()-1
+  aabb_t			bounds;		// grid bounds (all spheres)
+  int				res[3];		// cells per axis
+  double			invsize[3];	// 1 / cellsize
+  std::vector<int>		start;		// per cell offset into cells, plus end
+  std::vector<int>		cells;		// light indices, cell by cell
+};
+
+#endif
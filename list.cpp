@@ -1,5 +1,6 @@
 #include <iostream>
 
+#include "simd.h"
 #include "vector.h"
 #include "pixel.h"
 #include "light.h"
@@ -7,6 +8,9 @@
 #include "object.h"
 #include "list.h"
 
+// forward declarations
+class group_t;
+
 template <typename T>
 typename list_t<T>::const_iterator list_t<T>::insert(list_t<T>::const_iterator itr,const T& data)
 {
@@ -35,3 +39,4 @@ typename list_t<T>::iterator list_t<T>::erase(list_t<T>::iterator itr)
 template class list_t<light_t *>;
 template class list_t<material_t *>;
 template class list_t<object_t *>;
+template class list_t<group_t *>;
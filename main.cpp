@@ -9,18 +9,31 @@
 #include <cstdlib>
 #include <cstdio>
 #include <vector>
+#include <algorithm>
 
+#include "simd.h"
 #include "vector.h"
 #include "pixel.h"
+#include "aabb.h"
 #include "camera.h"
+#include "options.h"
 #include "light.h"
 #include "material.h"
 #include "object.h"
 #include "list.h"
 #include "plane.h"
+#include "packet.h"
+#include "pool.h"
+#include "accel.h"
+#include "bvh.h"
+#include "grid.h"
+#include "tiles.h"
+#include "lightgrid.h"
 #include "model.h"
 #include "ray.h"
+#include "wavefront.h"
 #include "timer.h"
+#include "alloc.h"
 #include "photon.h"
 #include "kdtree.h"
 
@@ -32,6 +45,8 @@ int main(int argc, char *argv[])
 	model_t		model;		// model (the world)
 	std::ifstream	model_ifs;	// input file stream
 	atd::timer_t	timer;
+	long		allocs;		// heap allocations while rendering
+	long		rays;		// rays traced while rendering
 
   if(argc != 2) {
     std::cerr << "Usage " << argv[0] << " <model_file>" << std::endl;
@@ -41,6 +56,10 @@ int main(int argc, char *argv[])
   // open file, read in model
   model_ifs.open(argv[1],std::ifstream::in);
   model_ifs >> model;
+  if(model_ifs.bad()) {
+    std::cerr << argv[1] << ": can't load model" << std::endl;
+    return 1;
+  }
   model_ifs.close();
 
 
@@ -54,16 +73,23 @@ int main(int argc, char *argv[])
 	double		ww=model.getworld_w(), wh=model.getworld_h();
 	vec_t		pos=model.getviewpoint();
 	vec_t		pix,dir;
-	ray_t		*ray=NULL;
+	ray_t		ray;
 	rgb_t<double>	color;
 	rgb_t<uchar>	*imgloc,*img=NULL;
 
+	// packet tracing of primary rays (pixel blocks of bw x bh)
+	int		packet=model.getpacket(), bw, bh, k;
+	packet_t	pkt;
+
+	// breadth first engine, a batch of rays at a time
+	wavefront_t	*wave=NULL;
+
 	double						scale, stuck;
 	//photon_t					*min;
 	//photon_t					*max;
-	std::vector<photon_t *>				photons;
-	std::vector<photon_t *>::iterator		pwitr;
-	kdtree_t<photon_t, photon_t*, photon_c> 	kdtree;
+	std::vector<photonrec_t>			photons;
+	std::vector<photonrec_t>::iterator		pwitr;
+	kdtree_t<photonrec_t, photonrec_t, photonrec_c> kdtree;	// built once, shared read-only
 
 
   model.shoot(photons);
@@ -83,36 +109,28 @@ int main(int argc, char *argv[])
   }
 */
   int sz = photons.size();
-  photon_t min = *photons[0];
-  photon_t max = *photons[sz-1];
 
   for(int i=0;i<photons.size();i++)
   {
-    vec_t pw = photons[i]->get_power();
+    vec_t pw = photons[i].get_power();
 
     pw[0]=pw[0]/sz;
     pw[1]=pw[1]/sz;
     pw[2]=pw[2]/sz;
 
-    photons[i]->change_power(pw);
-
-    if(*photons[i] > max) max=*photons[i];
-    if(*photons[i] < min) min=*photons[i];
-
-  }
-/*
-  // compute the min and max to construct a kdtree with
-  min = photons.begin(); 
-  max = photons.begin();
-  for(pwitr = photons.begin(); pwitr != photons.end(); pwitr++)
-  {
-    if(min > (*pwitr)) { min = (*pwitr); }
-    if(max < (*pwitr)) { max = (*pwitr); }
+    photons[i].change_power(pw);
   }
-*/
 
-  // construct kdtree with the vector of photons
-  kdtree.insert(photons, min, max);
+  // construct kdtree with the vector of photons (no bounds needed, the
+  // tree is left balanced over whatever points it is given). it is handed
+  // to every ray but not read while rendering: the flux gather in
+  // ray_t::trace() is still commented out
+  timer.start();
+  kdtree.insert(photons);
+  timer.end();
+  std::vector<photonrec_t>().swap(photons);	// the tree has its own copies
+  std::cerr << "built photon map: " << kdtree.size() << " photons, ";
+  std::cerr << timer.elapsed_ms() << " ms" << std::endl;
 
   img = new rgb_t<uchar>[w*h];
   memset(img,0,3*w*h);
@@ -124,8 +142,13 @@ int main(int argc, char *argv[])
     if((tid = omp_get_thread_num())==0)
       ncores = omp_get_num_threads();
   }
-  chunk = h/ncores;
+  chunk = std::max(1, h/ncores);
 
+  // made before timing starts, it sizes all its queues up front
+  if(model.getwavefront()) wave = new wavefront_t();
+
+  model.clearrays();
+  allocs = alloc_count();
   timer.start();
 
 // two statements...
@@ -136,44 +159,103 @@ int main(int argc, char *argv[])
 
 // ...or all-in-one
 
-  #pragma omp parallel for \
-            shared(model,w,h,ww,wh,wz,pos,img) \
-            private(tid,wx,wy,pix,dir,ray,color,imgloc, kdtree) \
-            schedule(static,chunk)
-  for(int y=h-1;y>=0;y--) {
-    for(int x=0;x<w;x++) {
-      wx = (double)x/(double)(w-1) * ww;
-      wy = (double)y/(double)(h-1) * wh;
-
-      // set pixel position vector (in world coordinates)
-      pix = vec_t(wx,wy,wz);
+  if(wave) {
+    wave->render(model,img);
+  } else if(packet > 1) {
+    // 2x2, 4x2 or 4x4 blocks: trace the block's primary rays as a packet,
+    // then shade each lane on its own (secondary rays are traced singly)
+    bw = packet >= 8 ? 4 : 2;
+    bh = packet / bw;
+    chunk = std::max(1, (h + bh - 1) / bh / ncores);
+
+    #pragma omp parallel for \
+              shared(model,w,h,ww,wh,wz,pos,img,bw,bh) \
+              private(tid,wx,wy,pix,dir,color,imgloc,pkt,k) \
+              schedule(static,chunk)
+    for(int by=0;by<(h+bh-1)/bh;by++) {
+      for(int bx=0;bx<w;bx+=bw) {
+        pkt.clear();
+        for(int y=by*bh;y<by*bh+bh && y<h;y++) {
+          for(int x=bx;x<bx+bw && x<w;x++) {
+            wx = (double)x/(double)(w-1) * ww;
+            wy = (double)y/(double)(h-1) * wh;
+
+            // same primary ray as below
+            pix = vec_t(wx,wy,wz);
+            dir = pix - pos;
+            dir = dir.norm();
+            pkt.add(pos,dir);
+          }
+        }
+
+        // closest hits for the whole block (blocks never straddle tiles)
+        model.find_closest(pkt,model.gettile(bx,by*bh));
+
+        k = 0;
+        for(int y=by*bh;y<by*bh+bh && y<h;y++) {
+          for(int x=bx;x<bx+bw && x<w;x++,k++) {
+            color.zero();
+
+            // shade the lane's hit as trace() would
+            if(pkt.obj[k] && pkt.dist[k] <= MAX_DIST) {
+		ray_t	lray(pos,pkt.dir[k],pkt.dist[k]);
+
+              lray.shade(model,color,0,pkt.obj[k],pkt.hit[k],pkt.N[k]);
+            }
+
+            imgloc = img + y*w + x;
+            for(int i=0;i<3;i++) (*imgloc)[i] = static_cast<uchar>(255.0 * color[i]);
+          }
+        }
+      }
+    }
+  } else {
+    #pragma omp parallel for \
+              shared(model,w,h,ww,wh,wz,pos,img,kdtree) \
+              private(tid,wx,wy,pix,dir,ray,color,imgloc) \
+              schedule(static,chunk)
+    for(int y=h-1;y>=0;y--) {
+      for(int x=0;x<w;x++) {
+        wx = (double)x/(double)(w-1) * ww;
+        wy = (double)y/(double)(h-1) * wh;
 
-      // compute the vector difference  v3 = v2 - v1
-      dir = pix - pos;
+        // set pixel position vector (in world coordinates)
+        pix = vec_t(wx,wy,wz);
 
-      // our ray is now {pos, dir} (in world coordinates), normalize dir
-      dir = dir.norm();
+        // compute the vector difference  v3 = v2 - v1
+        dir = pix - pos;
 
-      // zero out color
-      color.zero();
+        // our ray is now {pos, dir} (in world coordinates), normalize dir
+        dir = dir.norm();
 
-      // spawn new ray
-      ray = new ray_t(pos,dir);
+        // zero out color
+        color.zero();
 
-      // trace ray
-      ray->trace(model, color, 0, kdtree);
+        // our ray (on the stack, as are the secondary rays it spawns)
+        ray = ray_t(pos,dir);
 
-      // nuke this ray, we don't need it anymore, prevent memory leak
-      delete ray;
+        // trace ray
+        ray.trace(model, color, 0, kdtree, model.gettile(x,y));
 
-      // where are we in the image (using old i*c + j)
-      imgloc = img + y*w + x;
+        // where are we in the image (using old i*c + j)
+        imgloc = img + y*w + x;
 
-      // scale pixel by maxval, store at dereferenced image location
-      for(int i=0;i<3;i++) (*imgloc)[i] = static_cast<uchar>(255.0 * color[i]);
+        // scale pixel by maxval, store at dereferenced image location
+        for(int i=0;i<3;i++) (*imgloc)[i] = static_cast<uchar>(255.0 * color[i]);
+      }
     }
   }
   timer.end();
+  allocs = alloc_count() - allocs;
+  rays = model.getrays();
+  delete wave;
+
+  // steady state rendering should allocate nothing (-DALLOC_COUNT)
+  if(alloc_counting()) {
+    std::cerr << "allocs: " << allocs << " per frame, " << rays << " rays, ";
+    std::cerr << (rays > 0 ? (double)allocs / rays : 0.0) << " per ray";
+    std::cerr << std::endl;
+  }
 
   std::cerr << "cores: " << ncores << ", ";
   std::cerr << "time: " << timer.elapsed_ms() << " ms" << std::endl;
@@ -187,10 +269,9 @@ int main(int argc, char *argv[])
     }
   }
   std::ofstream file ("test.pts");
-  std::vector<photon_t* >::iterator pitr;
-  for(pitr = photons.begin(); pitr != photons.end(); pitr++)
+  for(int i=0;i<kdtree.size();i++)
   {
-    file << *(*pitr) << std::endl;
+    file << kdtree[i] << std::endl;
   }
 
   file.close();
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <string>
 
+#include "simd.h"
 #include "pixel.h"
 #include "material.h"
 
@@ -45,5 +46,11 @@ std::istream& operator>>(std::istream& s, material_t& rhs)
   // eat '}' character
   while(s.good() && s.get(c) && (c != '}'));
 
+  // classify by the terms present (the tests shading used to make per hit)
+  rhs.cls = 0;
+  if(!rhs.diffuse.iszero()) rhs.cls |= MAT_DIFFUSE;
+  if(!rhs.specular.iszero()) rhs.cls |= MAT_SPECULAR;
+  if(rhs.alpha > 0.0) rhs.cls |= MAT_TRANSMIT;
+
   return s;
 }
@@ -3,6 +3,14 @@
 
 #define MAT_COOKIE 32456123
 
+// material classes: which shading terms a material has, set at load (an
+// ambient-only material is class 0). shading is specialized per class,
+// see ray_t::local()
+#define MAT_DIFFUSE	1
+#define MAT_SPECULAR	2
+#define MAT_TRANSMIT	4
+#define MAT_CLASSES	8
+
 class material_t
 {
   public:
@@ -13,7 +21,8 @@ class material_t
 	diffuse(0.0,0.0,0.0), \
 	specular(0.0,0.0,0.0), \
 	alpha(0.0), \
-	ior(0.0) \
+	ior(0.0), \
+	cls(0) \
 	{ };
 
   // copy constructor
@@ -24,7 +33,8 @@ class material_t
 	diffuse(rhs.diffuse), \
 	specular(rhs.specular), \
 	alpha(rhs.alpha), \
-	ior(rhs.ior) \
+	ior(rhs.ior), \
+	cls(rhs.cls) \
 	{ };
 
   // destructors (default ok, no 'new' in constructor)
@@ -42,6 +52,7 @@ class material_t
 	    specular = rhs.specular;
 	    alpha = rhs.alpha;
 	    ior = rhs.ior;
+	    cls = rhs.cls;
 	  }
           return *this;
 	}
@@ -58,16 +69,18 @@ class material_t
   // methods
   int		getcookie()	{ return cookie; }
   std::string	getname()	{ return name; }
-  rgb_t<double>	getamb()	{ return ambient; }
-  rgb_t<double>	getdiff()	{ return diffuse; }
-  rgb_t<double>	getspec()	{ return specular; }
-  float		getalpha()	{ return alpha; }
-  float		getior()	{ return ior; }
+  const rgb_t<double>& getamb() const	{ return ambient; }
+  const rgb_t<double>& getdiff() const	{ return diffuse; }
+  const rgb_t<double>& getspec() const	{ return specular; }
+  float		getalpha() const	{ return alpha; }
+  float		getior() const	{ return ior; }
+  int		getclass() const	{ return cls; }
 
   private:
   int		cookie;		// magic number
   float		alpha;		// number to access for transmission
   float		ior;		//
+  int		cls;		// MAT_* bits
   std::string	name;		// material name
   rgb_t<double>	ambient;	// ambient color
   rgb_t<double>	diffuse;	// ambient color
@@ -0,0 +1,403 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+#include "simd.h"
+#include "vector.h"
+#include "precision.h"
+#include "pixel.h"
+#include "aabb.h"
+#include "material.h"
+#include "object.h"
+#include "timer.h"
+#include "mesh.h"
+
+// comparator for std::nth_element: triangle centroids along one axis
+class meshcmp_c
+{
+  public:
+  meshcmp_c(const std::vector<float>& c, int a) : \
+	cent(c), axis(a) \
+	{ };
+
+  bool operator()(int i, int j) const
+	{ return cent[3*i+axis] < cent[3*j+axis]; }
+
+  private:
+  const std::vector<float>&	cent;
+  int				axis;
+};
+
+std::ostream& mesh_t::put(std::ostream& s) const
+{
+  // get parent to print itself
+  object_t::put(s);
+
+  s << "  file " << file << std::endl;
+  s << "  scale " << scale << std::endl;
+  s << "  offset " << offset << std::endl;
+  s << "  # " << nverts() << " vertices, " << ntris() << " triangles" << std::endl;
+
+  s << "}" << std::endl << std::endl;
+
+  return s;
+}
+
+std::istream& mesh_t::get(std::istream& s)
+{
+	char		c;
+	std::string	attrname;
+
+  // get parent to read itself
+  object_t::get(s);
+
+  // loop until we hit '}'
+  while((c = s.peek()) != '}') {
+
+    // read in attribute name and trailing whitespace
+    s >> attrname >> std::ws;
+
+    if(attrname == "file")
+      s >> file >> std::ws;
+
+    if(attrname == "scale")
+      s >> scale >> std::ws;
+
+    if(attrname == "offset")
+      s >> offset >> std::ws;
+  }
+
+  // eat '}' character
+  while(s.good() && s.get(c) && (c != '}'));
+
+  // init: geometry comes from the OBJ file (scale and offset applied)
+  load(file);
+
+  return s;
+}
+
+// read the vertices and faces of a Wavefront OBJ file (everything else is
+// skipped), polygons are split into triangle fans; the file is read in
+// one go and parsed in place
+int mesh_t::load(const std::string& path)
+{
+	FILE			*fp;
+	std::vector<char>	buf;
+	std::vector<int>	poly;
+	std::vector<int>	kept;
+	char			*p, *q, *end;
+	long			size, idx;
+	int			nv, bad=0;
+	atd::timer_t		timer;
+
+  verts.clear();
+  tris.clear();
+  nodes.clear();
+
+  timer.start();
+
+  if((fp = fopen(path.c_str(), "rb")) == NULL) {
+    std::cerr << "mesh " << name << ": can't open " << path << std::endl;
+    return(-1);
+  }
+  fseek(fp, 0, SEEK_END);
+  size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  buf.resize(size + 1);
+  if(size > 0 && fread(&buf[0], 1, size, fp) != (size_t)size) {
+    std::cerr << "mesh " << name << ": can't read " << path << std::endl;
+    fclose(fp);
+    return(-1);
+  }
+  fclose(fp);
+  buf[size] = '\0';
+
+  // rough guess: a vertex line and two triangles per ~60 bytes
+  verts.reserve(3 * (size / 60 + 1));
+  tris.reserve(6 * (size / 60 + 1));
+
+  p = &buf[0];
+  end = p + size;
+  while(p < end) {
+    while(*p == ' ' || *p == '\t') p++;
+
+    if(p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+      // vertex: x y z [w]
+      p += 2;
+      for(int i=0; i<3; i++)
+        verts.push_back((float)(strtod(p, &p) * scale + offset[i]));
+    } else if(p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+      // face: v, v/vt, v//vn or v/vt/vn per corner, 1-based or negative
+      p += 2;
+      nv = (int)verts.size() / 3;
+      poly.clear();
+      while(true) {
+        while(*p == ' ' || *p == '\t') p++;
+        idx = strtol(p, &q, 10);
+        if(q == p) break;
+        poly.push_back(idx < 0 ? nv + (int)idx : (int)idx - 1);
+        for(p = q; *p && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r'; p++);
+      }
+      for(int k=2; k<(int)poly.size(); k++) {
+        tris.push_back(poly[0]);
+        tris.push_back(poly[k-1]);
+        tris.push_back(poly[k]);
+      }
+    }
+
+    // next line
+    while(p < end && *p != '\n') p++;
+    p++;
+  }
+
+  // drop triangles that reference missing vertices
+  nv = nverts();
+  kept.reserve(tris.size());
+  for(int t=0; t<(int)tris.size(); t+=3) {
+    if(tris[t] < 0 || tris[t] >= nv || tris[t+1] < 0 || tris[t+1] >= nv ||
+       tris[t+2] < 0 || tris[t+2] >= nv) { bad++; continue; }
+    kept.insert(kept.end(), tris.begin() + t, tris.begin() + t + 3);
+  }
+  tris.swap(kept);
+
+  build();
+
+  timer.end();
+
+  std::cerr << "mesh " << name << ": " << nverts() << " vertices, ";
+  std::cerr << ntris() << " triangles, " << nodes.size() << " nodes";
+  if(bad) std::cerr << " (" << bad << " bad faces dropped)";
+  std::cerr << ", " << timer.elapsed_ms() << " ms" << std::endl;
+
+  return(ntris());
+}
+
+void mesh_t::build()
+{
+	std::vector<float>	cent(tris.size());
+	std::vector<int>	idx(ntris());
+	std::vector<int>	sorted(tris.size());
+
+  nodes.clear();
+  if(tris.empty()) return;
+
+  for(int t=0; t<ntris(); t++) {
+    for(int a=0; a<3; a++)
+      cent[3*t+a] = (verts[3*tris[3*t]+a] + verts[3*tris[3*t+1]+a] +
+                     verts[3*tris[3*t+2]+a]) / 3.0f;
+    idx[t] = t;
+  }
+
+  nodes.reserve(2 * ntris() / MESH_LEAF_MAX + 1);
+  build(idx, cent, 0, ntris());
+
+  // store triangles in leaf order so leaves index them directly
+  for(int t=0; t<ntris(); t++)
+    for(int k=0; k<3; k++) sorted[3*t+k] = tris[3*idx[t]+k];
+  tris.swap(sorted);
+}
+
+// median split along the widest axis of the centroids; returns the node.
+// boxes are merged bottom-up so each triangle is bounded only once
+int mesh_t::build(std::vector<int>& idx, const std::vector<float>& cent,
+                  int first, int count)
+{
+	int	n = (int)nodes.size(), mid, axis, right;
+	float	lo[3], hi[3], extent[3];
+	aabb_t	box;
+
+  nodes.push_back(meshnode_t());
+
+  // centroid bounds
+  for(int a=0; a<3; a++) { lo[a] = HUGE_VAL; hi[a] = -HUGE_VAL; }
+  for(int i=first; i<first+count; i++) {
+	const float	*c = &cent[3*idx[i]];
+
+    for(int a=0; a<3; a++) {
+      if(c[a] < lo[a]) lo[a] = c[a];
+      if(c[a] > hi[a]) hi[a] = c[a];
+    }
+  }
+  for(int a=0; a<3; a++) extent[a] = hi[a] - lo[a];
+  axis = extent[0] > extent[1] ? 0 : 1;
+  if(extent[2] > extent[axis]) axis = 2;
+
+  // leaf: few triangles, or all centroids in one spot
+  if(count <= MESH_LEAF_MAX || extent[axis] <= 0.0f) {
+    for(int i=first; i<first+count; i++)
+      for(int k=0; k<3; k++) box.grow(vertex(tris[3*idx[i]+k]));
+    nodes[n].box = box;
+    nodes[n].first = first;
+    nodes[n].count = count;
+    return n;
+  }
+
+  mid = first + count / 2;
+  std::nth_element(idx.begin() + first, idx.begin() + mid,
+                   idx.begin() + first + count, meshcmp_c(cent, axis));
+
+  // left child follows its parent, right child index goes in the node
+  build(idx, cent, first, mid - first);
+  right = build(idx, cent, mid, first + count - mid);
+  box = nodes[n+1].box;
+  box.grow(nodes[right].box);
+  nodes[n].box = box;
+  nodes[n].first = right;
+  nodes[n].count = 0;
+  nodes[n].axis = axis;
+
+  return n;
+}
+
+// watertight ray/triangle test (Woop, Benthin, Wald): a, b, c are the
+// vertices relative to the ray origin, the ray is permuted so kz is its
+// dominant axis and sheared onto +z; edges shared by two triangles are
+// never missed by both
+static double triangle(const vec_t& a, const vec_t& b, const vec_t& c,
+                       int kx, int ky, int kz, double Sx, double Sy, double Sz)
+{
+	double	ax, ay, bx, by, cx, cy, u, v, w, det, t;
+
+  ax = a[kx] - Sx * a[kz];
+  ay = a[ky] - Sy * a[kz];
+  bx = b[kx] - Sx * b[kz];
+  by = b[ky] - Sy * b[kz];
+  cx = c[kx] - Sx * c[kz];
+  cy = c[ky] - Sy * c[kz];
+
+  // scaled barycentrics, all of one sign inside (either winding)
+  u = cx * by - cy * bx;
+  v = ax * cy - ay * cx;
+  w = bx * ay - by * ax;
+  if((u < 0.0 || v < 0.0 || w < 0.0) && (u > 0.0 || v > 0.0 || w > 0.0))
+    return(-1);
+
+  det = u + v + w;
+  if(det == 0.0) return(-1);
+
+  t = (u * Sz * a[kz] + v * Sz * b[kz] + w * Sz * c[kz]) / det;
+
+  return(t);
+}
+
+// closest triangle along the ray, its index in tri (-1 for none)
+double	mesh_t::closest(const vec_t& pos, const vec_t& dir, int& tri) const
+{
+	double		inv[3], best = HUGE_VAL, t, Sx, Sy, Sz;
+	int		stack[MESH_STACK], sp=0, n=0, kx, ky, kz;
+
+  tri = -1;
+  if(nodes.empty()) return(-1);
+
+  // per-ray setup of the watertight test
+  kz = fabs(dir[0]) > fabs(dir[1]) ? 0 : 1;
+  if(fabs(dir[2]) > fabs(dir[kz])) kz = 2;
+  kx = (kz + 1) % 3;
+  ky = (kx + 1) % 3;
+  if(dir[kz] < 0.0) std::swap(kx, ky);
+  Sx = dir[kx] / dir[kz];
+  Sy = dir[ky] / dir[kz];
+  Sz = 1.0 / dir[kz];
+
+  for(int i=0; i<3; i++) inv[i] = 1.0 / dir[i];
+
+  while(true) {
+	const meshnode_t&	node = nodes[n];
+
+    if(node.box.hits(pos, inv, 0.0, best)) {
+      if(node.count > 0) {
+        for(int i=node.first; i<node.first+node.count; i++) {
+          t = triangle(vertex(tris[3*i]) - pos, vertex(tris[3*i+1]) - pos,
+                       vertex(tris[3*i+2]) - pos, kx, ky, kz, Sx, Sy, Sz);
+          if((HIT_EPS < t) && (t < best)) { best = t; tri = i; }
+        }
+      } else {
+        // near child first
+        if(dir[node.axis] < 0.0) {
+          stack[sp++] = n + 1;
+          n = node.first;
+        } else {
+          stack[sp++] = node.first;
+          n = n + 1;
+        }
+        continue;
+      }
+    }
+
+    if(sp == 0) break;
+    n = stack[--sp];
+  }
+
+  return(best == HUGE_VAL ? -1 : best);
+}
+
+// the last hit found by each thread: the closest hit's surface is
+// nearly always asked for right after its hits(), on the same thread
+static const mesh_t	*hitmesh = NULL;
+static int		hittri = -1;
+static double		hitray[7];	// pos, dir, t
+#pragma omp threadprivate(hitmesh,hittri,hitray)
+
+double	mesh_t::hits(const vec_t& pos, const vec_t& dir)
+{
+	double	t;
+	int	tri;
+
+  assert(cookie == OBJ_COOKIE);
+
+  if((t = closest(pos, dir, tri)) < 0.0) return(-1);
+
+  hitmesh = this;
+  hittri = tri;
+  for(int i=0; i<3; i++) { hitray[i] = pos[i]; hitray[3+i] = dir[i]; }
+  hitray[6] = t;
+
+  return(t);
+}
+
+// the normal of the triangle hit: the one hits() recorded, unless this
+// thread has hit something else since (then the ray is traced again)
+object_t* mesh_t::surface(const vec_t& pos, const vec_t& dir, double t,
+                          vec_t& hit, vec_t& N)
+{
+	vec_t	a, b, c;
+	int	tri = -1;
+	bool	same = hitmesh == this && hitray[6] == t;
+	double	len;
+
+  hit = pos + t * dir;
+
+  for(int i=0; i<3 && same; i++)
+    same = hitray[i] == pos[i] && hitray[3+i] == dir[i];
+  if(same) tri = hittri;
+  else     closest(pos, dir, tri);
+
+  if(tri < 0) {
+    N = -dir.norm();
+    return this;
+  }
+
+  // geometric normal (counter-clockwise winding faces out)
+  a = vertex(tris[3*tri]);
+  b = vertex(tris[3*tri+1]);
+  c = vertex(tris[3*tri+2]);
+  N = (b - a).cross(c - a);
+  if((len = N.len()) == 0.0) N = -dir.norm();
+  else                       N = (1.0 / len) * N;
+
+  return this;
+}
+
+bool	mesh_t::getbounds(aabb_t& box)
+{
+  if(nodes.empty()) return false;
+
+  box = nodes[0].box;
+
+  return true;
+}
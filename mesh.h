@@ -0,0 +1,103 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <vector>
+
+#define MESH_LEAF_MAX	4	// max triangles per leaf
+#define MESH_STACK	64	// traversal stack depth
+
+// indexed triangle mesh loaded from a Wavefront OBJ file; vertices are
+// stored once as floats and triangles as index triples, both shared by
+// an internal bvh (median split) so the mesh is a single object as far
+// as the model and its acceleration structure are concerned
+class mesh_t : public object_t
+{
+  private:
+  struct meshnode_t
+  {
+	aabb_t	box;
+	int	first;		// leaf: first triangle, interior: right child
+	int	count;		// leaf: triangle count, interior: 0
+	int	axis;		// split axis (interior only)
+
+	meshnode_t() : first(0), count(0), axis(0)	{ };
+  };
+
+  public:
+  // constructors (overloaded)
+  mesh_t(std::string token) : \
+        object_t(token), \
+	file(), \
+	scale(1.0), \
+	offset(0.0,0.0,0.0), \
+	verts(), \
+	tris(), \
+	nodes() \
+	{ };
+
+  // copy constructor
+  mesh_t(const mesh_t& rhs) : \
+        object_t(rhs), \
+	file(rhs.file), \
+	scale(rhs.scale), \
+	offset(rhs.offset), \
+	verts(rhs.verts), \
+	tris(rhs.tris), \
+	nodes(rhs.nodes) \
+	{ };
+
+  // destructors (default ok, no 'new' in constructor)
+  ~mesh_t()
+	{ };
+
+  // operators (incl. assignment operator)
+  const mesh_t& operator=(const mesh_t& rhs)
+	{
+	  if(this != &rhs) {
+	    cookie = rhs.cookie;
+	    type = rhs.type;
+	    name = rhs.name;
+	    material = rhs.material;
+	    mat = rhs.mat;
+	    file = rhs.file;
+	    scale = rhs.scale;
+	    offset = rhs.offset;
+	    verts = rhs.verts;
+	    tris = rhs.tris;
+	    nodes = rhs.nodes;
+	  }
+          return *this;
+	}
+
+  // friends
+  std::ostream& put(std::ostream& s) const;
+  std::istream& get(std::istream& s);
+
+  // methods
+  double	hits(const vec_t&, const vec_t&);
+  object_t*	surface(const vec_t& pos, const vec_t& dir, double t,
+			vec_t& hit, vec_t& N);
+  bool		getbounds(aabb_t&);
+  int		nverts() const	{ return (int)verts.size() / 3; }
+  int		ntris() const	{ return (int)tris.size() / 3; }
+
+  int		load(const std::string& path);
+
+  private:
+  vec_t		vertex(int i) const
+			{ return vec_t(verts[3*i], verts[3*i+1], verts[3*i+2]); }
+  void		build();
+  int		build(std::vector<int>&, const std::vector<float>&, int, int);
+  double	closest(const vec_t& pos, const vec_t& dir, int& tri) const;
+
+  std::string			file;		// OBJ file name
+  double			scale;		// applied at load, then offset
+  vec_t				offset;
+
+  std::vector<float>		verts;		// x y z per vertex
+  std::vector<int>		tris;		// 3 vertex indices per triangle,
+						// in leaf order
+  std::vector<meshnode_t>	nodes;		// internal bvh
+};
+
+#endif
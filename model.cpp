@@ -7,15 +7,29 @@
 #include <cstring>
 #include <cmath>
 
+#include "simd.h"
 #include "vector.h"
+#include "precision.h"
+#include "fastmath.h"
 #include "pixel.h"
+#include "aabb.h"
 #include "camera.h"
+#include "options.h"
 #include "light.h"
 #include "material.h"
 #include "object.h"
 #include "list.h"
 #include "plane.h"
 #include "sphere.h"
+#include "mesh.h"
+#include "packet.h"
+#include "pool.h"
+#include "accel.h"
+#include "bvh.h"
+#include "grid.h"
+#include "instance.h"
+#include "tiles.h"
+#include "lightgrid.h"
 #include "model.h"
 #include "ray.h"
 #include "photon.h"
@@ -31,7 +45,9 @@ std::istream& operator>>(std::istream& s, model_t& rhs)
 	light_t		*lgt;
 	material_t	*mat;
 	object_t	*obj;
+	group_t		*grp;
 	std::string	token,name;
+	char		c;
 
   while(!s.eof()) {
 
@@ -48,29 +64,126 @@ std::istream& operator>>(std::istream& s, model_t& rhs)
         std::cerr << "loaded " << rhs.cam.getname() << std::endl;
       }
 
+      if(token == "options") {
+        s >> rhs.opts;
+        std::cerr << "loaded " << rhs.opts.getname() << std::endl;
+      }
+
       if(token == "material") {
         s >> (mat = new material_t());
         std::cerr << "loaded " << mat->getname() << std::endl;
         rhs.mats.push_back(mat);
       }
 
-      if(token == "plane") {
-        s >> (obj = new plane_t(token));
-        std::cerr << "loaded " << obj->getname() << std::endl;
-        rhs.objs.push_back(obj);
+      if(token == "group") {
+        // objects in a group only show up through instances
+        grp = new group_t();
+        s >> name;
+        grp->setname(name);
+        while(s.good() && s.get(c) && (c != '{'));
+        while((s >> token).good() && token != "}")
+          if((obj = rhs.getobject(s,token)) != NULL) grp->add(obj);
+        grp->build();
+        std::cerr << "loaded " << grp->getname() << std::endl;
+        rhs.grps.push_back(grp);
       }
 
-      if(token == "sphere") {
-        s >> (obj = new sphere_t(token));
-        std::cerr << "loaded " << obj->getname() << std::endl;
+      if((obj = rhs.getobject(s,token)) != NULL)
         rhs.objs.push_back(obj);
-      }
     }
   }
 
+  // objects take their materials once the whole file is read (materials
+  // can be defined anywhere); a missing one, or an object rejected while
+  // reading, makes the load fail
+  if(!rhs.resolve() || rhs.rejected > 0) {
+    s.setstate(std::ios::badbit);
+    return s;
+  }
+
+  // build acceleration structures over the loaded objects
+  rhs.build();
+
   return s;
 }
 
+// read one object of the kind named by token, NULL if token isn't an
+// object (or the object can't be used)
+object_t* model_t::getobject(std::istream& s, std::string token)
+{
+	object_t	*obj=NULL;
+	instance_t	*inst;
+	mesh_t		*msh;
+
+  if(token == "plane")  s >> (obj = new plane_t(token));
+  if(token == "sphere") s >> (obj = new sphere_t(token));
+
+  if(token == "mesh") {
+    // a mesh whose file can't be loaded, or holds no triangles, is an
+    // error (it would have no bounds and be tested by every ray)
+    s >> (msh = new mesh_t(token));
+    if(msh->ntris() == 0) {
+      std::cerr << "mesh " << msh->getname() << ": no triangles" << std::endl;
+      delete msh;
+      rejected++;
+      return NULL;
+    }
+    obj = msh;
+  }
+
+  if(token == "instance") {
+    // groups must be defined before they are instanced
+    s >> (inst = new instance_t(token));
+    if(!getgroup(inst->getgroup())) {
+      std::cerr << "instance " << inst->getname() << ": no group ";
+      std::cerr << inst->getgroup() << std::endl;
+      delete inst;
+      rejected++;
+      return NULL;
+    }
+    inst->setgroup(getgroup(inst->getgroup()));
+    obj = inst;
+  }
+
+  if(obj) std::cerr << "loaded " << obj->getname() << std::endl;
+
+  return obj;
+}
+
+// resolve the material of every object, those in groups too; false if
+// any is missing (each one is reported)
+bool model_t::resolve()
+{
+	list_t<object_t* >::iterator	oitr;
+	list_t<group_t* >::iterator	gitr;
+	bool				ok = true;
+
+  for(oitr = objs.begin(); oitr != objs.end(); oitr++)
+    if(!resolve(*oitr)) ok = false;
+  for(gitr = grps.begin(); gitr != grps.end(); gitr++)
+    for(int i=0; i<(*gitr)->size(); i++)
+      if(!resolve((*gitr)->getmember(i))) ok = false;
+
+  return ok;
+}
+
+bool model_t::resolve(object_t *obj)
+{
+	material_t	*mat;
+
+  // an instance's hits take the materials of its group's members
+  if(obj->gettype() == "instance") return true;
+
+  if(!(mat = getmaterial(obj->getmaterial()))) {
+    std::cerr << obj->gettype() << " " << obj->getname() << ": no material ";
+    std::cerr << obj->getmaterial() << std::endl;
+    return false;
+  }
+  obj->setmaterial(mat);
+
+  return true;
+}
+
 std::ostream& operator<<(std::ostream& s, model_t& rhs)
 {
 	light_t				*lgt;
@@ -80,58 +193,213 @@ std::ostream& operator<<(std::ostream& s, model_t& rhs)
 	list_t<light_t* >::iterator	litr;
 	list_t<material_t* >::iterator	mitr;
 	list_t<object_t* >::iterator	oitr;
+	list_t<group_t* >::iterator	gitr;
 
-  // print out camera 
+  // print out camera and options
   s << rhs.cam;
+  s << rhs.opts;
 
   // print out lights, materials, objects 
   for(litr = rhs.lgts.begin(); litr != rhs.lgts.end(); litr++) s << *litr;
   for(mitr = rhs.mats.begin(); mitr != rhs.mats.end(); mitr++) s << *mitr;
+  for(gitr = rhs.grps.begin(); gitr != rhs.grps.end(); gitr++) s << *gitr;
   for(oitr = rhs.objs.begin(); oitr != rhs.objs.end(); oitr++) s << *oitr;
 
   return s;
 }
 
-object_t* model_t::find_closest(vec_t& pos, vec_t& dir,
-                                double& dist, vec_t& hit, vec_t& N)
+void model_t::build()
 {
-	// candidate object
-	double				c_dist;
-	vec_t				c_hit,c_N;
-	object_t			*c_obj=NULL;
+	aabb_t				box;
+	std::vector<object_t* >		bounded, planes;
+	std::vector<light_t* >		points;
+	list_t<object_t* >::iterator	oitr;
+	list_t<light_t* >::iterator	litr;
+
+  // split objects into bounded (go in the bvh) and unbounded (side list)
+  for(oitr = objs.begin(); oitr != objs.end(); oitr++) {
+    if((*oitr)->getbounds(box)) bounded.push_back(*oitr);
+    else                        planes.push_back(*oitr);
+  }
+  unbounded.setsingle(opts.getsingle());
+  unbounded.build(planes);
+
+  // acceleration structure is chosen per scene (options block)
+  if(accel) delete accel;
+  if(opts.getaccel() == "list")      accel = new accel_t();
+  else if(opts.getaccel() == "grid") accel = new grid_t();
+  else                               accel = new bvh_t();
+
+  accel->setsingle(opts.getsingle());
+  accel->setfast(opts.getfast());
+  accel->build(bounded);
+
+  std::cerr << "built " << accel << ", ";
+  std::cerr << unbounded.size() << " unbounded" << std::endl;
+
+  // per-tile object lists for primary rays, if asked for
+  tiles.build(cam, opts.gettile(), bounded, opts.getsingle(), opts.getfast());
+  if(tiles.count() > 0) std::cerr << "built " << tiles << std::endl;
+
+  // lights in shading order, with their culling grid
+  for(litr = lgts.begin(); litr != lgts.end(); litr++) points.push_back(*litr);
+  lights.build(points, opts.getlightcull());
+  std::cerr << "built " << lights << std::endl;
+
+  // last occluder cache: a row of every light's per thread, rows padded
+  // to a cache line so threads don't write to the same one
+  occstride = (lights.size() + 7) & ~7;
+  occluders.assign(omp_get_max_threads() * occstride, (object_t *)NULL);
+
+  // ray counts, one per thread (a cache line apart)
+  rays.assign(omp_get_max_threads() * RAY_STRIDE, 0);
+
+  if(opts.getfast()) fastmath_report(std::cerr);
+}
 
+// tile is the screen tile a primary ray goes through (-1 otherwise), its
+// object list stands in for the acceleration structure
+object_t* model_t::find_closest(vec_t& pos, vec_t& dir,
+                                double& dist, vec_t& hit, vec_t& N, int tile)
+{
 	// closest object thus far
 	double				closest_dist=INFINITY;
-	vec_t				closest_hit,closest_N;
 	object_t			*closest_obj=NULL;
+	int				id=-1;
 
-	list_t<object_t* >::iterator	oitr;
+  // bounded objects: query the tile's list or the acceleration structure
+  if(tile >= 0) {
+	const spheres_t&	pool = tiles.getpool(tile);
 
-  // check each object; basic list iteration
-  for(oitr = objs.begin(); oitr != objs.end(); oitr++) {
-    c_obj = (object_t *)*oitr;
-    // if intersection behind us, ignore
-    if((c_dist = c_obj->hits(pos,dir,c_hit,c_N))<0)
-      continue;
-    // if distance to hit is smaller, set closest
-    else if((0.00001 < c_dist) && (c_dist < closest_dist)) {
-      closest_dist = c_dist;
-      closest_obj = c_obj;
-      closest_hit = c_hit;
-      closest_N = c_N;
-    } else
-      continue;
-  }
+    pool.closest(pos,dir,0,pool.size(),closest_dist,id);
+    if(id >= 0) closest_obj = pool.getobj(id);
+    id = -1;
+  } else
+    closest_obj = accel->closest(pos,dir,closest_dist);
+
+  // unbounded objects: compiled plane list
+  unbounded.closest(pos,dir,closest_dist,id);
+  if(id >= 0) closest_obj = unbounded.getobj(id);
 
+  countrays(1);
+
+  // hit point and normal are only needed for the closest object
   if(closest_obj) {
-    hit = closest_hit;
-    N = closest_N;
-    dist += closest_dist;
+    closest_obj = closest_obj->surface(pos,dir,closest_dist,hit,N);
+    if(closest_obj) dist += closest_dist;
   }
 
   return(closest_obj);
 }
 
+// same as above for each lane of a packet
+void model_t::find_closest(packet_t& pkt, int tile)
+{
+	char				all[PACKET_MAX];
+	int				id;
+
+  for(int k=0; k<pkt.n; k++) pkt.dist[k] = INFINITY;
+  countrays(pkt.n);
+
+  // bounded objects: the tile's list or the accelerator, either way the
+  // packet is traced as a whole
+  if(tile >= 0) {
+	const spheres_t&	pool = tiles.getpool(tile);
+
+    for(int k=0; k<pkt.n; k++) { all[k] = 1; pkt.id[k] = -1; }
+    pool.closest(pkt,all,0,pool.size());
+    for(int k=0; k<pkt.n; k++)
+      pkt.obj[k] = pkt.id[k] < 0 ? NULL : pool.getobj(pkt.id[k]);
+  } else
+    accel->closest(pkt);
+
+  for(int k=0; k<pkt.n; k++) {
+    // unbounded objects, lane by lane
+    id = -1;
+    unbounded.closest(pkt.pos[k],pkt.dir[k],pkt.dist[k],id);
+    if(id >= 0) pkt.obj[k] = unbounded.getobj(id);
+
+    if(pkt.obj[k])
+      pkt.obj[k] = pkt.obj[k]->surface(pkt.pos[k],pkt.dir[k],pkt.dist[k],
+                                       pkt.hit[k],pkt.N[k]);
+  }
+}
+
+// rays traced (closest hit queries) since clearrays(), all threads
+long model_t::getrays() const
+{
+	long	n = 0;
+
+  for(int i=0; i<(int)rays.size(); i+=RAY_STRIDE) n += rays[i];
+
+  return n;
+}
+
+void model_t::clearrays()
+{
+  for(int i=0; i<(int)rays.size(); i++) rays[i] = 0;
+}
+
+void model_t::countrays(int n)
+{
+	int	row = omp_get_thread_num();
+
+  if((row + 1) * RAY_STRIDE <= (int)rays.size()) rays[row * RAY_STRIDE] += n;
+}
+
+// the last occluder found for each light (in the calling thread's row of
+// the cache): neighbouring pixels are usually shadowed by the same object,
+// so it is tested first
+bool model_t::occluded(const vec_t& pos, const vec_t& dir,
+                       double maxdist, int light)
+{
+	object_t			*obj=NULL;
+	object_t			**occluder=NULL;
+	double				t;
+	int				id, row = omp_get_thread_num();
+	bool				cached;
+
+  cached = 0 <= light && light < lights.size() &&
+           (row + 1) * occstride <= (int)occluders.size();
+  if(cached) occluder = &occluders[row * occstride];
+
+  // try the cached occluder for this light first
+  if(cached && (obj = occluder[light]) != NULL) {
+    t = obj->hits(pos,dir);
+    if((HIT_EPS < t) && (t < maxdist)) return true;
+  }
+
+  // any-hit queries: stop at the first blocker
+  if((obj = accel->occluded(pos,dir,maxdist)) == NULL &&
+     (id = unbounded.any(pos,dir,maxdist)) >= 0)
+    obj = unbounded.getobj(id);
+
+  if(cached && obj) occluder[light] = obj;
+
+  return(obj != NULL);
+}
+
+// origin of a secondary ray leaving hit (normal N) in direction d; with
+// float intersection the hit point is only good to a few float ulps so it
+// is pushed off the surface, in double it is used as is
+vec_t model_t::origin(const vec_t& hit, const vec_t& N, const vec_t& d)
+{
+  return opts.getsingle() ? offset_origin(hit,N,d) : hit;
+}
+
+group_t* model_t::getgroup(std::string name)
+{
+	group_t				*grp;
+	list_t<group_t* >::iterator	gitr;
+
+  for(gitr = grps.begin(); gitr != grps.end(); gitr++) {
+    grp = (group_t *)*gitr;
+    assert(grp->getcookie() == GRP_COOKIE);
+    if(grp->getname() == name) return grp;
+  }
+  return NULL;
+}
+
 material_t* model_t::getmaterial(std::string name)
 {
 	material_t			*mat;
@@ -145,28 +413,33 @@ material_t* model_t::getmaterial(std::string name)
   return NULL;
 }
 
-void	model_t::shoot(std::vector<photon_t* >& photons)
+void	model_t::shoot(std::vector<photonrec_t>& photons)
 {
   list_t<light_t* >::iterator	litr;
+  int				shots = 2000;	// per light, of each kind
+
+  // each photon is traced on the stack, the ones that stick are kept as
+  // compact records in one array, sized for every shot up front
+  photons.reserve(photons.size() + 2 * shots * lights.size());
 
   for(litr = lgts.begin(); litr != lgts.end(); litr++)
   {
     int i;
 
-    for(i = 0; i < 2000; i++)
+    for(i = 0; i < shots; i++)
     {
-      photon_t* phot = new photon_t((*litr)->getlocation());
+      photon_t phot((*litr)->getlocation(), fastmath());
 
-      if(phot -> caustic(*this, 0))
-        { photons.push_back(phot); }
+      if(phot.caustic(*this, 0))
+        { photons.push_back(photonrec_t(phot.get_pos(), phot.get_dir(), phot.get_power())); }
     }
 
-    for(i = 0; i < 2000; i++)
+    for(i = 0; i < shots; i++)
     {
-      photon_t* phot = new photon_t((*litr)->getlocation());
+      photon_t phot((*litr)->getlocation(), fastmath());
 
-      if(phot -> global(*this, 0))
-       { photons.push_back(phot); }
+      if(phot.global(*this, 0))
+       { photons.push_back(photonrec_t(phot.get_pos(), phot.get_dir(), phot.get_power())); }
     }
   }
 }
@@ -6,6 +6,11 @@
 // forward declarations
 class ray_t;
 class photon_t;
+class photonrec_t;
+class packet_t;
+class group_t;
+
+#define RAY_STRIDE	8	// ray counters per thread (one used, a cache line)
 
 class model_t
 {
@@ -14,28 +19,23 @@ class model_t
   model_t() : \
 	lgts(), \
         cam(), \
+	opts(), \
 	mats(), \
-	objs() \
+	grps(), \
+	objs(), \
+	accel(NULL), \
+	unbounded(), \
+	tiles(), \
+	lights(), \
+	occluders(), \
+	occstride(0), \
+	rays(), \
+	rejected(0) \
 	{ }
 
-  // copy constructor
-  model_t(const model_t& rhs)
-	{
-	  lgts = rhs.lgts;
-	  cam = rhs.cam;
-	  mats = rhs.mats;
-	  objs = rhs.objs;
-	}
-
-  // destructors (default ok)
+  // destructor, the model owns its acceleration structure
   ~model_t()
-	{ };
-
-  // operators (incl. assignment operator)
-  const model_t& operator=(const model_t& rhs)
-	{
-          return *this;
-	}
+	{ delete accel; }
 
   // friends
   friend std::ostream& operator<<(std::ostream& s, model_t& rhs);
@@ -55,17 +55,52 @@ class model_t
   double	getworld_w()	{ return cam.getww(); }
   double	getworld_h()	{ return cam.getwh(); }
   vec_t		getviewpoint()	{ return cam.getview_point(); }
+  int		getpacket()	{ return opts.getpacket(); }
+  int		gettile(int x, int y)	{ return tiles.which(x,y); }
+  bool		fastmath()	{ return opts.getfast(); }
+  double	getcutoff()	{ return opts.getcutoff(); }
+  int		getroulette()	{ return opts.getroulette(); }
+  bool		getwavefront()	{ return opts.getwavefront(); }
+  bool		getreorder()	{ return opts.getreorder(); }
 
-  void		shoot(std::vector<photon_t* >& photons);
-  object_t*	find_closest(vec_t&,vec_t&,double&,vec_t&,vec_t&);
+  void		build();
+  void		shoot(std::vector<photonrec_t>& photons);
+  object_t*	find_closest(vec_t&,vec_t&,double&,vec_t&,vec_t&,int tile=-1);
+  void		find_closest(packet_t&,int tile=-1);
+  bool		occluded(const vec_t&,const vec_t&,double,int light=-1);
+  vec_t		origin(const vec_t&,const vec_t&,const vec_t&);
+  long		getrays() const;
+  void		clearrays();
   material_t*	getmaterial(std::string name);
+  group_t*	getgroup(std::string name);
 
-  // data members
   private:
+  object_t*	getobject(std::istream& s, std::string token);
+  bool		resolve();
+  bool		resolve(object_t *obj);
+  void		countrays(int n);
+
+  // not copyable: accel is owned, and there's only ever the one model
+  model_t(const model_t&);
+  model_t&	operator=(const model_t&);
+
+  // data members
   list_t<light_t* >		lgts;
   camera_t			cam;
+  options_t			opts;
   list_t<material_t* >		mats;
+  list_t<group_t* >		grps;		// instanced object groups
   list_t<object_t* >		objs;
+
+  // acceleration structures, built once after loading
+  accel_t			*accel;		// bounded objects
+  planes_t			unbounded;	// e.g., planes
+  tiles_t			tiles;		// primary ray object lists
+  lightgrid_t			lights;		// lights, for shading
+  std::vector<object_t* >	occluders;	// last occluder, per thread and light
+  int				occstride;	// occluders per thread (row)
+  std::vector<long>		rays;		// rays traced, per thread
+  int				rejected;	// objects that failed to load
 };
 
 #endif
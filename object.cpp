@@ -1,6 +1,7 @@
 #include <iostream>
 #include <string>
 
+#include "simd.h"
 #include "vector.h"
 #include "pixel.h"
 #include "material.h"
@@ -38,7 +39,22 @@ std::istream& object_t::get(std::istream& s)
   return s;
 }
 
-double	object_t::hits(const vec_t& pos,const vec_t& dir,vec_t& hit,vec_t& N)
+double	object_t::hits(const vec_t& pos,const vec_t& dir)
 {
   std::cerr << "object_t::hits: shouldn't be called" << std::endl;
+  return(-1);
+}
+
+void	object_t::getnormal(const vec_t& hit,vec_t& N)
+{
+  std::cerr << "object_t::getnormal: shouldn't be called" << std::endl;
+}
+
+object_t* object_t::surface(const vec_t& pos, const vec_t& dir, double t,
+                            vec_t& hit, vec_t& N)
+{
+  hit = pos + t * dir;
+  getnormal(hit,N);
+
+  return this;
 }
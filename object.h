@@ -3,13 +3,18 @@
 
 #define OBJ_COOKIE 12345678
 
+// forward declarations
+class aabb_t;
+class material_t;
+
 class object_t
 {
   public:
   // constructors (overloaded)
   object_t(std::string itype = std::string("unknown")) : \
 	type(itype), \
-	cookie(OBJ_COOKIE) \
+	cookie(OBJ_COOKIE), \
+	mat(NULL) \
 	{ };
 
   // copy constructor
@@ -17,11 +22,12 @@ class object_t
 	cookie(rhs.cookie), \
 	type(rhs.type), \
 	name(rhs.name), \
-	material(rhs.material) \
+	material(rhs.material), \
+	mat(rhs.mat) \
 	{ };
 
-  // destructors (default ok)
-  ~object_t()
+  // destructors (virtual, objects are deleted through object_t*)
+  virtual ~object_t()
 	{ };
 
   // operators (incl. assignment operator)
@@ -32,6 +38,7 @@ class object_t
 	    type = rhs.type;
 	    name = rhs.name;
 	    material = rhs.material;
+	    mat = rhs.mat;
 	  }
           return *this;
 	}
@@ -52,18 +59,34 @@ class object_t
   std::string	gettype()	{ return type; }
   std::string	getname()	{ return name; }
   std::string	getmaterial()	{ return material; }
+  material_t*	getmat() const	{ return mat; }
+  void		setmaterial(material_t *imat)	{ mat = imat; }
 
   virtual std::ostream& put(std::ostream& s) const;
   virtual std::istream& get(std::istream& s);
 
-  // methods (virtual void, dreived class must define)
-  virtual double	hits(const vec_t&,const vec_t&,vec_t&,vec_t&);
+  // bounding box, unbounded objects (e.g., planes) return false
+  virtual bool		getbounds(aabb_t&)	{ return false; }
+
+  // methods (virtual void, dreived class must define); hits() returns
+  // only the distance along the ray, the normal is computed afterwards
+  // for the closest object alone
+  virtual double	hits(const vec_t&,const vec_t&);
+  virtual void		getnormal(const vec_t&,vec_t&);
+
+  // hit point and normal at distance t along a ray known to hit this
+  // object; returns the object whose material applies (this one, unless
+  // the object is made of others, e.g. an instance), NULL for no surface
+  // after all (taken as a miss)
+  virtual object_t*	surface(const vec_t& pos, const vec_t& dir, double t,
+				vec_t& hit, vec_t& N);
 
   protected:
   int		cookie;		// magic number
   std::string	type;		// e.g., plane, sphere, etc.
   std::string	name;		// e.g., left_wall, center_sphere, etc.
   std::string	material;	// material
+  material_t	*mat;		// resolved at load
 };
 
 #endif
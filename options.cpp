@@ -0,0 +1,134 @@
+#include <iostream>
+#include <string>
+#include <cassert>
+
+#include "options.h"
+
+std::ostream& operator<<(std::ostream& s, const options_t& rhs)
+{
+  assert(rhs.cookie == OPT_COOKIE);
+
+  // print out 'options' token and options name
+  s << "options " << rhs.name.c_str() << std::endl;
+
+  s << "{" << std::endl;
+  s << "  accel " << rhs.accel << std::endl;
+  s << "  packet " << rhs.packet << std::endl;
+  s << "  tile " << rhs.tile << std::endl;
+  s << "  precision " << rhs.precision << std::endl;
+  s << "  math " << rhs.math << std::endl;
+  s << "  cutoff " << rhs.cutoff << std::endl;
+  s << "  roulette " << rhs.roulette << std::endl;
+  s << "  lightcull " << rhs.lightcull << std::endl;
+  s << "  engine " << rhs.engine << std::endl;
+  s << "  reorder " << rhs.reorder << std::endl;
+  s << "}" << std::endl << std::endl;
+
+  return s;
+}
+
+std::istream& operator>>(std::istream& s, options_t& rhs)
+{
+	char		c;
+	std::string	attrname;
+
+  s >> rhs.name;
+
+  // consume all chars until we get to '{'
+  while(s.good() && s.get(c) && (c != '{'));
+
+  // loop until we hit '}'
+  while(s.good() && (c = s.peek()) != '}') {
+
+    // read in attribute name
+    s >> attrname;
+
+    // read in attribute and consume whitespace at EOL
+    if(attrname == "accel") s >> rhs.accel >> std::ws;
+    else if(attrname == "packet") s >> rhs.packet >> std::ws;
+    else if(attrname == "tile") s >> rhs.tile >> std::ws;
+    else if(attrname == "precision") s >> rhs.precision >> std::ws;
+    else if(attrname == "math") s >> rhs.math >> std::ws;
+    else if(attrname == "cutoff") s >> rhs.cutoff >> std::ws;
+    else if(attrname == "roulette") s >> rhs.roulette >> std::ws;
+    else if(attrname == "lightcull") s >> rhs.lightcull >> std::ws;
+    else if(attrname == "engine") s >> rhs.engine >> std::ws;
+    else if(attrname == "reorder") s >> rhs.reorder >> std::ws;
+    else {
+      std::cerr << "options " << rhs.name << ": bad attribute " << attrname << std::endl;
+      std::getline(s, attrname);
+      s >> std::ws;
+    }
+  }
+
+  if(rhs.accel != "bvh" && rhs.accel != "grid" && rhs.accel != "list") {
+    std::cerr << "options " << rhs.name << ": bad accel " << rhs.accel;
+    std::cerr << ", using bvh" << std::endl;
+    rhs.accel = "bvh";
+  }
+
+  // packets are 2x2, 4x2 or 4x4 pixel blocks
+  if(rhs.packet != 1 && rhs.packet != 4 && rhs.packet != 8 && rhs.packet != 16) {
+    std::cerr << "options " << rhs.name << ": bad packet size " << rhs.packet;
+    std::cerr << ", using 1" << std::endl;
+    rhs.packet = 1;
+  }
+
+  // tiles hold whole packets
+  if(rhs.tile < 0 || rhs.tile % 4) {
+    std::cerr << "options " << rhs.name << ": bad tile size " << rhs.tile;
+    std::cerr << " (multiple of 4), using 0" << std::endl;
+    rhs.tile = 0;
+  }
+
+  if(rhs.precision != "double" && rhs.precision != "float") {
+    std::cerr << "options " << rhs.name << ": bad precision " << rhs.precision;
+    std::cerr << ", using double" << std::endl;
+    rhs.precision = "double";
+  }
+
+  if(rhs.math != "exact" && rhs.math != "fast") {
+    std::cerr << "options " << rhs.name << ": bad math " << rhs.math;
+    std::cerr << ", using exact" << std::endl;
+    rhs.math = "exact";
+  }
+
+  if(rhs.cutoff < 0.0) {
+    std::cerr << "options " << rhs.name << ": bad cutoff " << rhs.cutoff;
+    std::cerr << ", using 0" << std::endl;
+    rhs.cutoff = 0.0;
+  }
+
+  if(rhs.roulette < 0) {
+    std::cerr << "options " << rhs.name << ": bad roulette depth " << rhs.roulette;
+    std::cerr << ", using 0 (off)" << std::endl;
+    rhs.roulette = 0;
+  }
+
+  if(rhs.lightcull < 0.0) {
+    std::cerr << "options " << rhs.name << ": bad lightcull " << rhs.lightcull;
+    std::cerr << ", using 0 (off)" << std::endl;
+    rhs.lightcull = 0.0;
+  }
+
+  if(rhs.engine != "pixel" && rhs.engine != "wavefront") {
+    std::cerr << "options " << rhs.name << ": bad engine " << rhs.engine;
+    std::cerr << ", using pixel" << std::endl;
+    rhs.engine = "pixel";
+  }
+
+  if(rhs.reorder != "off" && rhs.reorder != "on") {
+    std::cerr << "options " << rhs.name << ": bad reorder " << rhs.reorder;
+    std::cerr << ", using off" << std::endl;
+    rhs.reorder = "off";
+  }
+
+  // the pixel engine traces secondary rays as they are made
+  if(rhs.reorder == "on" && rhs.engine != "wavefront")
+    std::cerr << "options " << rhs.name << ": reorder needs engine wavefront" << std::endl;
+
+  // eat '}' character
+  while(s.good() && s.get(c) && (c != '}'));
+
+  return s;
+}
@@ -0,0 +1,104 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#define OPT_COOKIE 73920411
+
+// per-scene render options, read from an optional 'options' block
+class options_t
+{
+  public:
+  // constructors (overloaded)
+  options_t() : \
+	cookie(OPT_COOKIE), \
+	name("default"), \
+	accel("bvh"), \
+	packet(1), \
+	tile(0), \
+	precision("double"), \
+	math("exact"), \
+	cutoff(0.0), \
+	roulette(0), \
+	lightcull(0.0), \
+	engine("pixel"), \
+	reorder("off") \
+	{ };
+
+  // copy constructor
+  options_t(const options_t& rhs) : \
+	cookie(rhs.cookie), \
+	name(rhs.name), \
+	accel(rhs.accel), \
+	packet(rhs.packet), \
+	tile(rhs.tile), \
+	precision(rhs.precision), \
+	math(rhs.math), \
+	cutoff(rhs.cutoff), \
+	roulette(rhs.roulette), \
+	lightcull(rhs.lightcull), \
+	engine(rhs.engine), \
+	reorder(rhs.reorder) \
+	{ };
+
+  // destructors (default ok, no 'new' in constructor)
+  ~options_t()
+	{ };
+
+  // operators (incl. assignment operator)
+  const options_t& operator=(const options_t& rhs)
+	{
+	  if(this != &rhs) {
+	    cookie = rhs.cookie;
+	    name = rhs.name;
+	    accel = rhs.accel;
+	    packet = rhs.packet;
+	    tile = rhs.tile;
+	    precision = rhs.precision;
+	    math = rhs.math;
+	    cutoff = rhs.cutoff;
+	    roulette = rhs.roulette;
+	    lightcull = rhs.lightcull;
+	    engine = rhs.engine;
+	    reorder = rhs.reorder;
+	  }
+          return *this;
+	}
+
+  // friends
+  friend std::ostream& operator<<(std::ostream& s, const options_t& rhs);
+  friend std::ostream& operator<<(std::ostream& s, options_t *rhs)
+		{ return(s << (*rhs)); }
+
+  friend std::istream& operator>>(std::istream& s, options_t& rhs);
+  friend std::istream& operator>>(std::istream& s, options_t *rhs)
+		{ return(s >> (*rhs)); }
+
+  // methods
+  int		getcookie()	{ return cookie; }
+  std::string	getname()	{ return name; }
+  std::string	getaccel()	{ return accel; }
+  int		getpacket()	{ return packet; }
+  int		gettile()	{ return tile; }
+  bool		getsingle()	{ return precision == "float"; }
+  bool		getfast()	{ return math == "fast"; }
+  double	getcutoff()	{ return cutoff; }
+  int		getroulette()	{ return roulette; }
+  double	getlightcull()	{ return lightcull; }
+  bool		getwavefront()	{ return engine == "wavefront"; }
+  bool		getreorder()	{ return reorder == "on"; }
+
+  private:
+  int		cookie;		// magic number
+  std::string	name;		// name
+  std::string	accel;		// acceleration structure: list, bvh, grid
+  int		packet;		// primary rays per packet: 1, 4, 8, 16
+  int		tile;		// primary ray culling tile size, 0: off
+  std::string	precision;	// intersection arithmetic: double, float
+  std::string	math;		// libm tier: exact, fast (approximate)
+  double	cutoff;		// least throughput a secondary ray needs, 0: off
+  int		roulette;	// russian roulette from this bounce on, 0: off
+  double	lightcull;	// least light contribution (color / r), 0: off
+  std::string	engine;		// renderer: pixel (depth first), wavefront
+  std::string	reorder;	// sort secondary rays (wavefront): off, on
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef PACKET_H
+#define PACKET_H
+
+#define PACKET_MAX	16	// max rays per packet (multiple of POOL_LANES)
+
+// a bundle of coherent rays (e.g., primary rays through a block of pixels)
+// traced together; ray data is kept both as vectors and as
+// structure-of-arrays so the batch kernels can load several lanes at once,
+// results are filled in per lane by model_t::find_closest
+class packet_t
+{
+  public:
+  // constructors
+  packet_t() : \
+	n(0) \
+	{
+	  for(int k=0; k<PACKET_MAX; k++) {
+	    ox[k] = oy[k] = oz[k] = dx[k] = dy[k] = dz[k] = a[k] = 0.0;
+	    inv[k][0] = inv[k][1] = inv[k][2] = 0.0;
+	    dist[k] = 0.0;
+	    id[k] = -1;
+	    obj[k] = NULL;
+	  }
+	};
+
+  // copy constructor (default member copies ok)
+  // destructors (default ok, no 'new' in constructor)
+
+  // methods
+  int		size() const	{ return n; }
+  bool		full() const	{ return n == PACKET_MAX; }
+  void		clear()		{ n = 0; }
+
+  // append a ray, returns its lane
+  int		add(const vec_t& p, const vec_t& d)
+	{
+	  pos[n] = p;
+	  dir[n] = d;
+	  ox[n] = p[0]; oy[n] = p[1]; oz[n] = p[2];
+	  dx[n] = d[0]; dy[n] = d[1]; dz[n] = d[2];
+	  a[n] = d.dot(d);
+	  for(int i=0; i<3; i++) inv[n][i] = 1.0 / d[i];
+	  dist[n] = 0.0;
+	  id[n] = -1;
+	  obj[n] = NULL;
+	  return n++;
+	}
+
+  // data members (public, like aabb_t)
+  int		n;			// lanes in use
+
+  // rays
+  vec_t		pos[PACKET_MAX], dir[PACKET_MAX];
+  double	ox[PACKET_MAX], oy[PACKET_MAX], oz[PACKET_MAX];
+  double	dx[PACKET_MAX], dy[PACKET_MAX], dz[PACKET_MAX];
+  double	a[PACKET_MAX];		// dir . dir
+  double	inv[PACKET_MAX][3];	// 1 / dir, for slab tests
+
+  // results
+  double	dist[PACKET_MAX];	// distance to the closest hit
+  int		id[PACKET_MAX];		// pool slot of the closest hit
+  object_t	*obj[PACKET_MAX];	// closest object, NULL if none
+  vec_t		hit[PACKET_MAX], N[PACKET_MAX];
+};
+
+#endif
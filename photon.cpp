@@ -4,29 +4,50 @@
 #include <string>
 #include <cassert>
 #include <cmath>
+#include <algorithm>
 
+#include "simd.h"
 #include "vector.h"
+#include "fastmath.h"
 #include "pixel.h"
+#include "aabb.h"
 #include "camera.h"
+#include "options.h"
 #include "light.h"
 #include "material.h"
 #include "object.h"
 #include "list.h"
 #include "plane.h"
+#include "pool.h"
+#include "accel.h"
+#include "bvh.h"
+#include "grid.h"
+#include "tiles.h"
+#include "lightgrid.h"
 #include "model.h"
 #include "ray.h"
 #include "photon.h"
 
 
-vec_t photon_t::genrand_hemisphere()
+vec_t photon_t::genrand_hemisphere(bool fast)
 {
 	double  azimuth = genrand(0.0, 2.0 * M_PI);
 	double  elevation = genrand(0.0, 2.0 * M_PI);
 
-	double  sinA = sin(azimuth), sinE = sin(elevation);
-	double  cosA = cos(azimuth), cosE = cos(elevation);
+	double  sinA, sinE, cosA, cosE;
 	vec_t   dir, vup;
 
+	if(fast)
+	{
+		fast_sincos(azimuth, sinA, cosA);
+		fast_sincos(elevation, sinE, cosE);
+	}
+	else
+	{
+		sinA = sin(azimuth); sinE = sin(elevation);
+		cosA = cos(azimuth); cosE = cos(elevation);
+	}
+
 	dir[0] = -sinA * cosE;  vup[0] =  sinA * sinE;
 	dir[1] =  sinE;       vup[1] =  cosE;
 	dir[2] =  cosA * cosE;  vup[2] = -cosA * sinE;
@@ -58,7 +79,7 @@ bool photon_t::caustic(model_t& model, int bounce)
 		dis += rdis;
 
 		// get object material properties
-		if((mat = model.getmaterial(obj -> getmaterial())) != NULL)
+		if((mat = obj->getmat()) != NULL)
 		{
 			ambient = mat -> getamb();
 			diffuse = mat -> getdiff();
@@ -83,9 +104,12 @@ bool photon_t::caustic(model_t& model, int bounce)
 		else
 		{
 			pos = hit;
+			stick();
 			return(true);
 		}
 	}
+
+	return(false);
 }
 
 bool photon_t::global(model_t& model, int bounce)
@@ -112,7 +136,7 @@ bool photon_t::global(model_t& model, int bounce)
 		dis += rdis;
 
 		// get object material properties
-		if((mat = model.getmaterial(obj->getmaterial())) != NULL)
+		if((mat = obj->getmat()) != NULL)
 		{
 			ambient = mat -> getamb();
 			diffuse = mat -> getdiff();
@@ -130,7 +154,7 @@ bool photon_t::global(model_t& model, int bounce)
 		{
 			// set pos and dir to hit and genrand_hemisphere().norm()
 			pos = hit;
-			dir = genrand_hemisphere().norm();
+			dir = genrand_hemisphere(model.fastmath()).norm();
 			// reflect the photon
 			return global(model, (bounce + 1));
 		}
@@ -149,7 +173,82 @@ bool photon_t::global(model_t& model, int bounce)
 		else if( (Kd + Ks < roulette) && (roulette < 1.0))
 		{
 			pos = hit;
+			stick();
 			return(true);
 		}
 	}
+
+	return(false);
+}
+
+photonrec_t::photonrec_t(const vec_t& p) : \
+	theta(0), \
+	phi(0), \
+	flag(0)
+{
+	for(int i = 0; i < 3; i++)	{ loc[i] = (float)p[i]; rgbe[i] = 0; }
+	rgbe[3] = 0;
+}
+
+photonrec_t::photonrec_t(const vec_t& p, const vec_t& d, const vec_t& pw) : \
+	theta(0), \
+	phi(0), \
+	flag(0)
+{
+	vec_t	u = d.norm();
+	double	t, f;
+
+	for(int i = 0; i < 3; i++)	{ loc[i] = (float)p[i]; }
+
+	// direction: polar angle from z in [0,pi], azimuth in [-pi,pi]
+	t = acos(std::max(-1.0, std::min(1.0, u[2])));
+	f = atan2(u[1], u[0]) + M_PI;
+	theta = (unsigned char)std::min(255, (int)(t * (256.0 / M_PI)));
+	phi = (unsigned char)((int)(f * (256.0 / (2.0 * M_PI))) & 255);
+
+	change_power(pw);
+}
+
+vec_t photonrec_t::get_dir() const
+{
+	double	t = (theta + 0.5) * (M_PI / 256.0);
+	double	f = (phi + 0.5) * (2.0 * M_PI / 256.0) - M_PI;
+
+	return(vec_t(sin(t) * cos(f), sin(t) * sin(f), cos(t)));
+}
+
+vec_t photonrec_t::get_power() const
+{
+	double	f;
+
+	if(rgbe[3] == 0)	{ return(vec_t(0.0, 0.0, 0.0)); }
+
+	f = ldexp(1.0, (int)rgbe[3] - (128 + 8));
+	return(vec_t(rgbe[0] * f, rgbe[1] * f, rgbe[2] * f));
+}
+
+// power as rgbe: the three mantissas share the exponent of the largest component
+// (the 8 bit mantissas are rounded, so a zero stays zero)
+void photonrec_t::change_power(const vec_t& rhs)
+{
+	double	v = std::max(rhs[0], std::max(rhs[1], rhs[2])), m;
+	int	e;
+
+	if(v < 1e-32)
+	{
+		rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+		return;
+	}
+
+	m = frexp(v, &e) * 256.0 / v;
+	for(int i = 0; i < 3; i++)
+		{ rgbe[i] = (unsigned char)std::max(0, std::min(255, (int)(rhs[i] * m + 0.5))); }
+	rgbe[3] = (unsigned char)(e + 128);
+}
+
+ostream& operator<<(ostream& s, const photonrec_t& rhs)
+{
+	vec_t	pw = rhs.get_power();
+
+	return(s << rhs.loc[0] << " " << rhs.loc[1] << " " << rhs.loc[2] << " " << pw[0] << " " << pw[1] << " " << pw[2]);
 }
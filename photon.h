@@ -19,31 +19,36 @@ class photon_t : public ray_t
 	photon_t() 
 	: ray_t(vec_t(0.0, 0.0, 0.0), genrand_hemisphere(), 0.0)
 	{
+		loc = fvec_t(0.0f, 0.0f, 0.0f);
 		power = vec_t(100.0, 100.0, 100.0);
 	}
 
 	// Constructors given a power vector
-	photon_t(const vec_t& p)
-	:ray_t(p, genrand_hemisphere(), 0.0)
+	photon_t(const vec_t& p, bool fast = false)
+	:ray_t(p, genrand_hemisphere(fast), 0.0)
 	{
+		loc = fvec_t(p);
 		power = vec_t(100.0, 100.0, 100.0);
 	}
 
 	// Copy constructor
 	photon_t(const photon_t& rhs)
 	{
+		loc = rhs.loc;
 		power = rhs.power;
 	}
 
 	photon_t(const vec_t& x, const vec_t& y, double z = 0.0)
 	:ray_t(x, y, z)
 	{
+		loc = fvec_t(x);
 		power = vec_t(100.0, 100.0, 100.0);
 	}
 	
 	// Assignment operator
 	const photon_t& operator=(const photon_t& rhs)
 	{
+		loc = rhs.loc;
 		power = rhs.power;
 		dis = rhs.dis;
 		dir = rhs.dir;
@@ -57,7 +62,7 @@ class photon_t : public ray_t
 	// output stream
 	friend ostream& operator<<(ostream& s, photon_t& rhs)
 	{
-		return(s << rhs.pos[0] << " " << rhs.pos[1] << " " << rhs.pos[2] << " "<< rhs.power[0] << " " << rhs.power[1] << " " << rhs.power[2]); 
+		return(s << rhs.loc[0] << " " << rhs.loc[1] << " " << rhs.loc[2] << " "<< rhs.power[0] << " " << rhs.power[1] << " " << rhs.power[2]); 
 	}
 	// input stream
 	friend istream& operator>>(istream& s, photon_t& rhs)
@@ -65,16 +70,16 @@ class photon_t : public ray_t
 		return s >> rhs.power[0] >> rhs.power[1] >> rhs.power[2];
 	}
 
-	// operator [] accessor
-	const double& operator[](int i) const  { return pos[i]; }
-	double& operator[](int i)              { return pos[i]; }
+	// operator [] accessor (the stored position, single precision)
+	const float& operator[](int i) const  { return loc[i]; }
+	float& operator[](int i)              { return loc[i]; }
 
 	// less than operator used to find the min
 	friend bool operator<(const photon_t& lhs, const photon_t& rhs)
 	{
 		for(int i = 0; i < 3; i++)
 		{
-			if(lhs.pos[i] > rhs.pos[i]) { return(false); }
+			if(lhs.loc[i] > rhs.loc[i]) { return(false); }
 		}
 		return(true);
 	}
@@ -84,7 +89,7 @@ class photon_t : public ray_t
 	{
 		for(int i = 0; i < 3; i++)
 		{
-			if(lhs.pos[i] < rhs.pos[i]) { return(false); }
+			if(lhs.loc[i] < rhs.loc[i]) { return(false); }
 		}
 		return(true);
 	}
@@ -95,8 +100,8 @@ class photon_t : public ray_t
 	double   genrand(double lo, double hi)
 	{  return( (double)(((double)rand()/(double)RAND_MAX)*hi + lo) );  }
 
-	// Set the direction for the photon
-	vec_t genrand_hemisphere();
+	// Set the direction for the photon (fast: approximate sin/cos)
+	vec_t genrand_hemisphere(bool fast = false);
 
 	// takes care of caustic photons
 	bool caustic(model_t& model, int bounce);
@@ -107,48 +112,93 @@ class photon_t : public ray_t
 	// lets others access the power member of photon
 	vec_t get_power()	{ return power; }
 
-	vec_t get_pos()		{ return pos; }
+	vec_t get_pos()		{ return vec_t(loc); }
+
+	// store the photon where it is now (when it sticks)
+	void stick()		{ loc = fvec_t(pos); }
 
 	vec_t get_dir()		{ return dir; }
 
 	// updates the power value
 	void change_power(vec_t rhs)	{ power = rhs; }
 
-	// compute the distance between a passed photon and the "this" photon given a vec_t 
-	double distance(const vec_t& rhs)
-		{ vec_t   diff = pos - rhs; return(sqrt(diff.dot(diff))); }
+	private:
+
+	fvec_t loc;	// position once stuck, float is plenty for lookups
+	vec_t power;
+};
+
+
+// a photon as the photon map stores it, by value: 20 bytes with its
+// position in floats, the direction it was heading as two bytes (theta,
+// phi), its power as shared exponent rgb (rgbe) and the axis the kd tree
+// splits its subtree on
+class photonrec_t
+{
+	public:
+
+	// constructors
+	photonrec_t() : \
+		theta(0), \
+		phi(0), \
+		flag(0) \
+		{ loc[0] = loc[1] = loc[2] = 0.0f; rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0; }
+
+	// a query point
+	photonrec_t(const vec_t& p);
 
-	// compute the distance between a passed photon and the "this" photon given a photon_t
-	double distance(const photon_t& rhs)
-		{ vec_t   diff = pos - rhs.pos; return(sqrt(diff.dot(diff))); }
+	// a stuck photon: where, heading which way, with what power
+	photonrec_t(const vec_t& p, const vec_t& d, const vec_t& pw);
 
-	double distance(photon_t*& rhs)
-		{ vec_t   diff = pos - rhs->pos; return(sqrt(diff.dot(diff))); }
+	// copy constructor (default member copies ok)
+	// destructors (default ok, no 'new' in constructor)
 
-	int dim()	{ return 3; }
+	// output stream (position and power)
+	friend ostream& operator<<(ostream& s, const photonrec_t& rhs);
+
+	// position
+	const float& operator[](int i) const	{ return loc[i]; }
+	vec_t	get_pos() const		{ return vec_t(loc[0], loc[1], loc[2]); }
+
+	// direction and power, unpacked
+	vec_t	get_dir() const;
+	vec_t	get_power() const;
+	void	change_power(const vec_t& rhs);
+
+	// squared distance between the two positions
+	double	distance2(const photonrec_t& rhs) const
+		{
+		  double dx = loc[0] - rhs.loc[0], dy = loc[1] - rhs.loc[1];
+		  double dz = loc[2] - rhs.loc[2];
+
+		  return(dx * dx + dy * dy + dz * dz);
+		}
+
+	int	dim() const		{ return 3; }
+
+	// kd tree split axis
+	int	getaxis() const		{ return flag; }
+	void	setaxis(int a)		{ flag = (short)a; }
 
 	private:
 
-	vec_t power;
+	float		loc[3];		// position
+	unsigned char	rgbe[4];	// power: mantissas, shared exponent
+	unsigned char	theta, phi;	// direction, in 256ths of pi, 2pi
+	short		flag;		// kd tree split axis
 };
 
 
-class photon_c
+class photonrec_c
 {
 	public:
 
 	// constructor
-	photon_c(int inputaxis = 0)  {  axis = inputaxis;  }
+	photonrec_c(int inputaxis = 0)  {  axis = inputaxis;  }
 
-	bool operator()(const photon_t& p1, const photon_t& p2) const
+	bool operator()(const photonrec_t& p1, const photonrec_t& p2) const
 		{  return( p1[axis] < p2[axis] );  }
 
-	bool operator()(const photon_t*& p1, const photon_t*& p2) const
-		{  return( (*p1)[axis] < (*p2)[axis] ); }
-
-	bool operator()(photon_t * const & p1, photon_t * const & p2) const
-		{ return((*p1)[axis] < (*p2)[axis]); }
-
 	private:
 
 	int axis;
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <cmath>
 
+#include "simd.h"
 #include "pixel.h"
 
 template <typename T>
@@ -19,7 +20,8 @@ rgb_t<T> operator*(const rgb_t<T>& lhs, const T& s)
 {
 	rgb_t<T>	result;
 
-    for(int i=0; i<3; i++) result[i] = s * lhs[i];
+    result = lhs;
+    result *= s;
 
     return result;
 }
@@ -29,7 +31,8 @@ rgb_t<T> operator*(const T& s, const rgb_t<T>& rhs)
 {
         rgb_t<T>        result;
 
-  for(int i=0; i<3; i++) result[i] = s * rhs[i];
+  result = rhs;
+  result *= s;
 
   return result;
 }
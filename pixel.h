@@ -16,17 +16,23 @@ template <typename T> rgb_t<T> operator*(const rgb_t<T>& rhs, const T& s);
 template <typename T> rgb_t<T> operator*(const T& s, const rgb_t<T>& rhs);
 template <typename T> rgb_t<T> operator-(const T& s, const rgb_t<T>& rhs);
 
+// color on channel type T; float and double colors are padded to 4 lanes
+// and go through the kernels in simd.h, uchar pixels stay 3 bytes (the
+// image buffer is written out as is)
 template <typename T>
 class rgb_t
 {
   public:
   // constructors (overloaded)
   rgb_t(T ix=0, T iy=0, T iz=0) \
-  { pix[0] = ix; pix[1] = iy; pix[2] = iz; };
+  {
+    pix[0] = ix; pix[1] = iy; pix[2] = iz;
+    for(int i=3; i<simd_t<T>::lanes; i++) pix[i] = T(0);
+  };
 
   // copy constructor
   rgb_t(const rgb_t& rhs) \
-  { for(int i=0; i<3; i++) pix[i] = rhs[i]; }
+  { for(int i=0; i<simd_t<T>::lanes; i++) pix[i] = rhs.pix[i]; }
 
   // destructors (but default ok)
   ~rgb_t()	{ };
@@ -34,7 +40,7 @@ class rgb_t
   // assignment operator
   rgb_t& operator=(const rgb_t& rhs)
   {
-    if(this != &rhs) for(int i=0; i<3; i++) pix[i] = rhs[i];
+    if(this != &rhs) for(int i=0; i<simd_t<T>::lanes; i++) pix[i] = rhs.pix[i];
 
     return *this;
   }
@@ -43,28 +49,44 @@ class rgb_t
   // http://www.cs.caltech.edu/courses/cs11/material/cpp/donnie/cpp-ops.html
   rgb_t& operator*=(const rgb_t& rhs)
   {
-    if(this != &rhs) for(int i=0; i<3; i++) pix[i] *= rhs[i];
+    if(this != &rhs) simd_mul(pix, pix, rhs.pix);
 
     return *this;
   }
 
   rgb_t& operator+=(const rgb_t& rhs)
   {
-    if(this != &rhs) for(int i=0; i<3; i++) pix[i] += rhs[i];
+    if(this != &rhs) simd_add(pix, pix, rhs.pix);
 
     return *this;
   }
 
   rgb_t& operator-=(const rgb_t& rhs)
   {
-    if(this != &rhs) for(int i=0; i<3; i++) pix[i] -= rhs[i];
+    if(this != &rhs) simd_sub(pix, pix, rhs.pix);
 
     return *this;
   }
 
   rgb_t& operator*=(const T& s)
   {
-    for(int i=0; i<3; i++) pix[i] *= s;
+    simd_scale(pix, pix, s);
+
+    return *this;
+  }
+
+  // fused multiply-adds: this += a * s and this += a * b, without the
+  // temporaries of the operator form (same result)
+  rgb_t& madd(const rgb_t& a, const T& s)
+  {
+    simd_madd(pix, a.pix, s);
+
+    return *this;
+  }
+
+  rgb_t& madd(const rgb_t& a, const rgb_t& b)
+  {
+    simd_madd(pix, a.pix, b.pix);
 
     return *this;
   }
@@ -133,7 +155,7 @@ class rgb_t
   }
 
   private:
-  T pix[3];
+  T pix[simd_t<T>::lanes];
 };
 
 #endif
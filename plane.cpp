@@ -3,6 +3,7 @@
 #include <cassert>
 #include <cmath>
 
+#include "simd.h"
 #include "vector.h"
 #include "pixel.h"
 #include "material.h"
@@ -51,26 +52,26 @@ std::istream& plane_t::get(std::istream& s)
   while(s.good() && s.get(c) && (c != '}'));
 
   // init
-  ndotq = point.dot(normal.norm());
+  unit = normal.norm();
+  ndotq = point.dot(unit);
 
   return s;
 }
 
-double	plane_t::hits(const vec_t& pos, const vec_t& dir, vec_t& hit, vec_t& N)
+double	plane_t::hits(const vec_t& pos, const vec_t& dir)
 {
 	double	ndotd,t,ndotb,precision=0.000001;
-	vec_t	last_hit;
 
   assert(cookie == OBJ_COOKIE);
 
   // get angle between view direction and plane normal
-  ndotd = dir.dot(normal.norm());
+  ndotd = dir.dot(unit);
 
   // if ndotd == 0, ray is parallel to the plane, no intersection
   if(fabs(ndotd) < precision) return(-1);
 
   // find distance of ray pos to plane: N . b + ndotq
-  ndotb = pos.dot(normal.norm());
+  ndotb = pos.dot(unit);
 
   // here we need to temporarily negate N to find distance along ray to plane
   t = (ndotq - ndotb) / ndotd;
@@ -78,12 +79,13 @@ double	plane_t::hits(const vec_t& pos, const vec_t& dir, vec_t& hit, vec_t& N)
   // if t < 0 then intersection "behind" where ray started from
   if(t <= 0) return(-1);
 
-  // hit point is obtained by moving along dir by t amount & adding to ray pos
-  last_hit = pos + t * dir;
-
   // if z > 0 then hit point is in front of image plane; invalid intersection
-  if(last_hit[2] > 0.0) return(-1);
-  else                  { hit = last_hit; N = normal.norm(); }
+  if(pos[2] + t * dir[2] > 0.0) return(-1);
 
   return(t);
 }
+
+void	plane_t::getnormal(const vec_t&, vec_t& N)
+{
+  N = unit;
+}
@@ -15,6 +15,7 @@ class plane_t : public object_t
         object_t(rhs), \
 	normal(rhs.normal), \
 	point(rhs.point), \
+	unit(rhs.unit), \
 	ndotq(rhs.ndotq)
 	{ };
 
@@ -30,8 +31,10 @@ class plane_t : public object_t
 	    type = rhs.type;
 	    name = rhs.name;
 	    material = rhs.material;
+	    mat = rhs.mat;
 	    normal = rhs.normal;
 	    point = rhs.point;
+	    unit = rhs.unit;
 	    ndotq = rhs.ndotq;
 	  }
           return *this;
@@ -42,11 +45,15 @@ class plane_t : public object_t
   std::istream& get(std::istream& s);
 
   // methods
-  double	hits(const vec_t&, const vec_t&, vec_t&, vec_t&);
+  double	hits(const vec_t&, const vec_t&);
+  void		getnormal(const vec_t&, vec_t&);
+  vec_t		getunit()	{ return unit; }
+  double	getndotq()	{ return ndotq; }
 
   private:
   vec_t normal;
   vec_t point;
+  vec_t unit;		// normalized normal (set at load)
   double ndotq;
 };
 
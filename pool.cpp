@@ -0,0 +1,545 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "simd.h"
+#include "vector.h"
+#include "precision.h"
+#include "fastmath.h"
+#include "pixel.h"
+#include "material.h"
+#include "object.h"
+#include "plane.h"
+#include "sphere.h"
+#include "packet.h"
+#include "pool.h"
+
+void spheres_t::build(const std::vector<object_t* >& prims)
+{
+	int	n = (int)prims.size();
+	int	padded = (n + POOL_LANES - 1) / POOL_LANES * POOL_LANES;
+	int	fpadded = (n + POOL_FLANES - 1) / POOL_FLANES * POOL_FLANES;
+
+  objs = prims;
+  generic = 0;
+
+  // pad with empty slots so a batch may always read a full register; only
+  // the arrays of the precision in use are kept
+  cx.assign(single ? 0 : padded, 0.0);
+  cy.assign(single ? 0 : padded, 0.0);
+  cz.assign(single ? 0 : padded, 0.0);
+  r2.assign(single ? 0 : padded, -HUGE_VAL);
+  fx.assign(single ? fpadded : 0, 0.0f);
+  fy.assign(single ? fpadded : 0, 0.0f);
+  fz.assign(single ? fpadded : 0, 0.0f);
+  fr2.assign(single ? fpadded : 0, -HUGE_VALF);
+
+  for(int i=0; i<n; i++) {
+    if(objs[i]->gettype() == "sphere") {
+	sphere_t	*sph = (sphere_t *)objs[i];
+	vec_t		center = sph->getcenter();
+
+      if(single) {
+        fx[i] = (float)center[0];
+        fy[i] = (float)center[1];
+        fz[i] = (float)center[2];
+        fr2[i] = (float)(sph->getradius() * sph->getradius());
+      } else {
+        cx[i] = center[0];
+        cy[i] = center[1];
+        cz[i] = center[2];
+        r2[i] = sph->getradius() * sph->getradius();
+      }
+    } else
+      generic++;
+  }
+}
+
+double spheres_t::hits(const vec_t& pos, const vec_t& dir, int i) const
+{
+	double	pcx, pcy, pcz, a, b, c, d, sd, t0, t1;
+
+  if(!sphere(i)) return objs[i]->hits(pos,dir);
+  if(single) return fhits(pos,dir,i);
+
+  // same arithmetic as sphere_t::hits, see there
+  pcx = pos[0] - cx[i];
+  pcy = pos[1] - cy[i];
+  pcz = pos[2] - cz[i];
+
+  a = dir.dot(dir);
+  b = 2.0 * (pcx*dir[0] + pcy*dir[1] + pcz*dir[2]);
+  c = (pcx*pcx + pcy*pcy + pcz*pcz) - r2[i];
+  d = b*b - 4.0*a*c;
+
+  if(d > 0) {
+    sd = fast ? fast_sqrt(d) : sqrt(d);
+    t0 = (-b - sd)/(2.0*a);
+    t1 = (-b + sd)/(2.0*a);
+    return (t0 > HIT_EPS && t0 < t1) ? t0 : t1;
+  }
+  return(-1);
+}
+
+// single precision version of hits(); the textbook discriminant loses
+// everything to cancellation in float once a sphere is far from the ray
+// origin (|pc|^2 - r^2), so it goes through the closest point of the line
+// to the center instead and takes the roots in the stable form
+double spheres_t::fhits(const vec_t& pos, const vec_t& dir, int i) const
+{
+	float	dx = (float)dir[0], dy = (float)dir[1], dz = (float)dir[2];
+	float	pcx, pcy, pcz, lx, ly, lz, a, b, c, d, q, t0, t1;
+
+  pcx = (float)pos[0] - fx[i];
+  pcy = (float)pos[1] - fy[i];
+  pcz = (float)pos[2] - fz[i];
+
+  a = dx*dx + dy*dy + dz*dz;
+  b = pcx*dx + pcy*dy + pcz*dz;			// half of the usual b
+  c = (pcx*pcx + pcy*pcy + pcz*pcz) - fr2[i];
+
+  // center to the closest point on the line, d is the discriminant / 4a
+  lx = pcx - (b/a)*dx;
+  ly = pcy - (b/a)*dy;
+  lz = pcz - (b/a)*dz;
+  d = fr2[i] - (lx*lx + ly*ly + lz*lz);
+
+  if(d > 0) {
+    q = -(b + copysignf(fast ? fast_sqrt(a*d) : sqrtf(a*d), b));
+    t0 = c/q;
+    t1 = q/a;
+    if(t1 < t0) { d = t0; t0 = t1; t1 = d; }
+    return (t0 > (float)HIT_EPS && t0 < t1) ? t0 : t1;
+  }
+  return(-1);
+}
+
+void spheres_t::fbatch(const vec_t& pos, const vec_t& dir, int i,
+                       double *t) const
+{
+  // distances for a batch of POOL_FLANES slots in float (same arithmetic
+  // as fhits), widened to double on the way out; lanes that miss get -1
+#if defined(__AVX__)
+	float	fa = (float)dir[0]*(float)dir[0] + (float)dir[1]*(float)dir[1] +
+		     (float)dir[2]*(float)dir[2];
+	__m256	a = _mm256_set1_ps(fa), zero = _mm256_setzero_ps();
+	__m256	sign = _mm256_set1_ps(-0.0f);
+	__m256	eps = _mm256_set1_ps((float)HIT_EPS), miss = _mm256_set1_ps(-1.0f);
+	__m256	pcx = _mm256_sub_ps(_mm256_set1_ps((float)pos[0]), _mm256_loadu_ps(&fx[i]));
+	__m256	pcy = _mm256_sub_ps(_mm256_set1_ps((float)pos[1]), _mm256_loadu_ps(&fy[i]));
+	__m256	pcz = _mm256_sub_ps(_mm256_set1_ps((float)pos[2]), _mm256_loadu_ps(&fz[i]));
+	__m256	r2 = _mm256_loadu_ps(&fr2[i]);
+	__m256	dx = _mm256_set1_ps((float)dir[0]);
+	__m256	dy = _mm256_set1_ps((float)dir[1]);
+	__m256	dz = _mm256_set1_ps((float)dir[2]);
+	__m256	b, c, d, s, q, ba, lx, ly, lz, t0, t1, tf;
+
+  b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pcx,dx),
+                                  _mm256_mul_ps(pcy,dy)),
+                    _mm256_mul_ps(pcz,dz));
+  c = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pcx,pcx),
+                                  _mm256_mul_ps(pcy,pcy)),
+                    _mm256_mul_ps(pcz,pcz));
+  c = _mm256_sub_ps(c, r2);
+  ba = _mm256_div_ps(b, a);
+  lx = _mm256_sub_ps(pcx, _mm256_mul_ps(ba,dx));
+  ly = _mm256_sub_ps(pcy, _mm256_mul_ps(ba,dy));
+  lz = _mm256_sub_ps(pcz, _mm256_mul_ps(ba,dz));
+  d = _mm256_sub_ps(r2, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx,lx),
+                                                    _mm256_mul_ps(ly,ly)),
+                                      _mm256_mul_ps(lz,lz)));
+  s = _mm256_mul_ps(a,d);
+  s = fast ? fast_sqrt(s) : _mm256_sqrt_ps(s);
+  s = _mm256_or_ps(s, _mm256_and_ps(b, sign));
+  q = _mm256_xor_ps(_mm256_add_ps(b, s), sign);
+  t0 = _mm256_div_ps(c, q);
+  t1 = _mm256_div_ps(q, a);
+  tf = _mm256_min_ps(t0, t1);
+  t1 = _mm256_max_ps(t0, t1);
+  t0 = tf;
+  tf = _mm256_blendv_ps(t1, t0,
+         _mm256_and_ps(_mm256_cmp_ps(t0, eps, _CMP_GT_OQ),
+                       _mm256_cmp_ps(t0, t1, _CMP_LT_OQ)));
+  tf = _mm256_blendv_ps(miss, tf, _mm256_cmp_ps(d, zero, _CMP_GT_OQ));
+  _mm256_storeu_pd(t, _mm256_cvtps_pd(_mm256_castps256_ps128(tf)));
+  _mm256_storeu_pd(t + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(tf, 1)));
+#elif defined(__SSE2__)
+	float	fa = (float)dir[0]*(float)dir[0] + (float)dir[1]*(float)dir[1] +
+		     (float)dir[2]*(float)dir[2];
+	__m128	a = _mm_set1_ps(fa), zero = _mm_setzero_ps();
+	__m128	sign = _mm_set1_ps(-0.0f);
+	__m128	eps = _mm_set1_ps((float)HIT_EPS), miss = _mm_set1_ps(-1.0f);
+	__m128	pcx = _mm_sub_ps(_mm_set1_ps((float)pos[0]), _mm_loadu_ps(&fx[i]));
+	__m128	pcy = _mm_sub_ps(_mm_set1_ps((float)pos[1]), _mm_loadu_ps(&fy[i]));
+	__m128	pcz = _mm_sub_ps(_mm_set1_ps((float)pos[2]), _mm_loadu_ps(&fz[i]));
+	__m128	r2 = _mm_loadu_ps(&fr2[i]);
+	__m128	dx = _mm_set1_ps((float)dir[0]);
+	__m128	dy = _mm_set1_ps((float)dir[1]);
+	__m128	dz = _mm_set1_ps((float)dir[2]);
+	__m128	b, c, d, s, q, ba, lx, ly, lz, t0, t1, tf, m;
+
+  b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pcx,dx), _mm_mul_ps(pcy,dy)),
+                 _mm_mul_ps(pcz,dz));
+  c = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pcx,pcx), _mm_mul_ps(pcy,pcy)),
+                 _mm_mul_ps(pcz,pcz));
+  c = _mm_sub_ps(c, r2);
+  ba = _mm_div_ps(b, a);
+  lx = _mm_sub_ps(pcx, _mm_mul_ps(ba,dx));
+  ly = _mm_sub_ps(pcy, _mm_mul_ps(ba,dy));
+  lz = _mm_sub_ps(pcz, _mm_mul_ps(ba,dz));
+  d = _mm_sub_ps(r2, _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx,lx),
+                                           _mm_mul_ps(ly,ly)),
+                                _mm_mul_ps(lz,lz)));
+  s = _mm_mul_ps(a,d);
+  s = fast ? fast_sqrt(s) : _mm_sqrt_ps(s);
+  s = _mm_or_ps(s, _mm_and_ps(b, sign));
+  q = _mm_xor_ps(_mm_add_ps(b, s), sign);
+  t0 = _mm_div_ps(c, q);
+  t1 = _mm_div_ps(q, a);
+  tf = _mm_min_ps(t0, t1);
+  t1 = _mm_max_ps(t0, t1);
+  t0 = tf;
+  m = _mm_and_ps(_mm_cmpgt_ps(t0, eps), _mm_cmplt_ps(t0, t1));
+  tf = _mm_or_ps(_mm_and_ps(m, t0), _mm_andnot_ps(m, t1));
+  m = _mm_cmpgt_ps(d, zero);
+  tf = _mm_or_ps(_mm_and_ps(m, tf), _mm_andnot_ps(m, miss));
+  _mm_storeu_pd(t, _mm_cvtps_pd(tf));
+  _mm_storeu_pd(t + 2, _mm_cvtps_pd(_mm_movehl_ps(tf, tf)));
+#else
+  t[0] = sphere(i) ? fhits(pos,dir,i) : -1.0;
+#endif
+}
+
+void spheres_t::batch(const vec_t& pos, const vec_t& dir, double a,
+                      int i, double *t) const
+{
+  // distances for a batch of slots (same arithmetic as sphere_t::hits,
+  // lanes that miss get -1)
+#if defined(__AVX__)
+	__m256d	two = _mm256_set1_pd(2.0), zero = _mm256_setzero_pd();
+	__m256d	twoa = _mm256_set1_pd(2.0*a), foura = _mm256_set1_pd(4.0*a);
+	__m256d	eps = _mm256_set1_pd(HIT_EPS), miss = _mm256_set1_pd(-1.0);
+	__m256d	pcx = _mm256_sub_pd(_mm256_set1_pd(pos[0]), _mm256_loadu_pd(&cx[i]));
+	__m256d	pcy = _mm256_sub_pd(_mm256_set1_pd(pos[1]), _mm256_loadu_pd(&cy[i]));
+	__m256d	pcz = _mm256_sub_pd(_mm256_set1_pd(pos[2]), _mm256_loadu_pd(&cz[i]));
+	__m256d	dx = _mm256_set1_pd(dir[0]);
+	__m256d	dy = _mm256_set1_pd(dir[1]);
+	__m256d	dz = _mm256_set1_pd(dir[2]);
+	__m256d	b, c, d, sd, nb, t0, t1, tf;
+
+  b = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(pcx,dx),
+                                  _mm256_mul_pd(pcy,dy)),
+                    _mm256_mul_pd(pcz,dz));
+  b = _mm256_mul_pd(two, b);
+  c = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(pcx,pcx),
+                                  _mm256_mul_pd(pcy,pcy)),
+                    _mm256_mul_pd(pcz,pcz));
+  c = _mm256_sub_pd(c, _mm256_loadu_pd(&r2[i]));
+  d = _mm256_sub_pd(_mm256_mul_pd(b,b), _mm256_mul_pd(foura,c));
+  sd = fast ? fast_sqrt(d) : _mm256_sqrt_pd(d);
+  nb = _mm256_sub_pd(zero, b);
+  t0 = _mm256_div_pd(_mm256_sub_pd(nb, sd), twoa);
+  t1 = _mm256_div_pd(_mm256_add_pd(nb, sd), twoa);
+  tf = _mm256_blendv_pd(t1, t0,
+         _mm256_and_pd(_mm256_cmp_pd(t0, eps, _CMP_GT_OQ),
+                       _mm256_cmp_pd(t0, t1, _CMP_LT_OQ)));
+  tf = _mm256_blendv_pd(miss, tf, _mm256_cmp_pd(d, zero, _CMP_GT_OQ));
+  _mm256_storeu_pd(t, tf);
+#elif defined(__SSE2__)
+	__m128d	two = _mm_set1_pd(2.0), zero = _mm_setzero_pd();
+	__m128d	twoa = _mm_set1_pd(2.0*a), foura = _mm_set1_pd(4.0*a);
+	__m128d	eps = _mm_set1_pd(HIT_EPS), miss = _mm_set1_pd(-1.0);
+	__m128d	pcx = _mm_sub_pd(_mm_set1_pd(pos[0]), _mm_loadu_pd(&cx[i]));
+	__m128d	pcy = _mm_sub_pd(_mm_set1_pd(pos[1]), _mm_loadu_pd(&cy[i]));
+	__m128d	pcz = _mm_sub_pd(_mm_set1_pd(pos[2]), _mm_loadu_pd(&cz[i]));
+	__m128d	dx = _mm_set1_pd(dir[0]);
+	__m128d	dy = _mm_set1_pd(dir[1]);
+	__m128d	dz = _mm_set1_pd(dir[2]);
+	__m128d	b, c, d, sd, nb, t0, t1, tf, m;
+
+  b = _mm_add_pd(_mm_add_pd(_mm_mul_pd(pcx,dx), _mm_mul_pd(pcy,dy)),
+                 _mm_mul_pd(pcz,dz));
+  b = _mm_mul_pd(two, b);
+  c = _mm_add_pd(_mm_add_pd(_mm_mul_pd(pcx,pcx), _mm_mul_pd(pcy,pcy)),
+                 _mm_mul_pd(pcz,pcz));
+  c = _mm_sub_pd(c, _mm_loadu_pd(&r2[i]));
+  d = _mm_sub_pd(_mm_mul_pd(b,b), _mm_mul_pd(foura,c));
+  sd = fast ? fast_sqrt(d) : _mm_sqrt_pd(d);
+  nb = _mm_sub_pd(zero, b);
+  t0 = _mm_div_pd(_mm_sub_pd(nb, sd), twoa);
+  t1 = _mm_div_pd(_mm_add_pd(nb, sd), twoa);
+  m = _mm_and_pd(_mm_cmpgt_pd(t0, eps), _mm_cmplt_pd(t0, t1));
+  tf = _mm_or_pd(_mm_and_pd(m, t0), _mm_andnot_pd(m, t1));
+  m = _mm_cmpgt_pd(d, zero);
+  tf = _mm_or_pd(_mm_and_pd(m, tf), _mm_andnot_pd(m, miss));
+  _mm_storeu_pd(t, tf);
+#else
+  t[0] = r2[i] == -HUGE_VAL ? -1.0 : hits(pos,dir,i);
+#endif
+}
+
+void spheres_t::closest(const vec_t& pos, const vec_t& dir, int first,
+                        int count, double& dist, int& id) const
+{
+	double	t[POOL_FLANES];
+	double	a = dir.dot(dir);
+	int	end = first + count, w = single ? POOL_FLANES : POOL_LANES;
+
+  for(int i=first; i<end; i+=w) {
+    if(single) fbatch(pos, dir, i, t);
+    else       batch(pos, dir, a, i, t);
+
+    // same acceptance test as the linear scan, in slot order
+    for(int j=0; j<w && i+j<end; j++) {
+      if((HIT_EPS < t[j]) && (t[j] < dist)) {
+        dist = t[j];
+        id = i + j;
+      }
+    }
+  }
+
+  // slots that aren't spheres go through the virtual hits()
+  if(generic) {
+    for(int i=first; i<end; i++) {
+	double	c_dist;
+
+      if(sphere(i)) continue;
+      if((c_dist = objs[i]->hits(pos,dir)) < 0) continue;
+      if((HIT_EPS < c_dist) && (c_dist < dist)) {
+        dist = c_dist;
+        id = i;
+      }
+    }
+  }
+}
+
+int spheres_t::any(const vec_t& pos, const vec_t& dir, int first,
+                    int count, double maxdist) const
+{
+	double	t[POOL_FLANES];
+	double	a = dir.dot(dir);
+	int	end = first + count, w = single ? POOL_FLANES : POOL_LANES;
+
+  for(int i=first; i<end; i+=w) {
+    if(single) fbatch(pos, dir, i, t);
+    else       batch(pos, dir, a, i, t);
+
+    // any hit in front of the ray and short of maxdist will do
+    for(int j=0; j<w && i+j<end; j++)
+      if((HIT_EPS < t[j]) && (t[j] < maxdist)) return i + j;
+  }
+
+  if(generic) {
+    for(int i=first; i<end; i++) {
+	double	c_dist;
+
+      if(sphere(i)) continue;
+      c_dist = objs[i]->hits(pos,dir);
+      if((HIT_EPS < c_dist) && (c_dist < maxdist)) return i;
+    }
+  }
+
+  return(-1);
+}
+
+void spheres_t::lanes(const packet_t& pkt, int i, int j, double *t) const
+{
+  // distances from slot i for a batch of packet lanes starting at j: the
+  // transpose of batch(), one sphere against several rays (same arithmetic
+  // as sphere_t::hits, lanes that miss get -1)
+#if defined(__AVX__)
+	__m256d	two = _mm256_set1_pd(2.0), four = _mm256_set1_pd(4.0);
+	__m256d	zero = _mm256_setzero_pd(), a = _mm256_loadu_pd(&pkt.a[j]);
+	__m256d	twoa = _mm256_mul_pd(two, a), foura = _mm256_mul_pd(four, a);
+	__m256d	eps = _mm256_set1_pd(HIT_EPS), miss = _mm256_set1_pd(-1.0);
+	__m256d	pcx = _mm256_sub_pd(_mm256_loadu_pd(&pkt.ox[j]), _mm256_set1_pd(cx[i]));
+	__m256d	pcy = _mm256_sub_pd(_mm256_loadu_pd(&pkt.oy[j]), _mm256_set1_pd(cy[i]));
+	__m256d	pcz = _mm256_sub_pd(_mm256_loadu_pd(&pkt.oz[j]), _mm256_set1_pd(cz[i]));
+	__m256d	dx = _mm256_loadu_pd(&pkt.dx[j]);
+	__m256d	dy = _mm256_loadu_pd(&pkt.dy[j]);
+	__m256d	dz = _mm256_loadu_pd(&pkt.dz[j]);
+	__m256d	b, c, d, sd, nb, t0, t1, tf;
+
+  b = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(pcx,dx),
+                                  _mm256_mul_pd(pcy,dy)),
+                    _mm256_mul_pd(pcz,dz));
+  b = _mm256_mul_pd(two, b);
+  c = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(pcx,pcx),
+                                  _mm256_mul_pd(pcy,pcy)),
+                    _mm256_mul_pd(pcz,pcz));
+  c = _mm256_sub_pd(c, _mm256_set1_pd(r2[i]));
+  d = _mm256_sub_pd(_mm256_mul_pd(b,b), _mm256_mul_pd(foura,c));
+  sd = fast ? fast_sqrt(d) : _mm256_sqrt_pd(d);
+  nb = _mm256_sub_pd(zero, b);
+  t0 = _mm256_div_pd(_mm256_sub_pd(nb, sd), twoa);
+  t1 = _mm256_div_pd(_mm256_add_pd(nb, sd), twoa);
+  tf = _mm256_blendv_pd(t1, t0,
+         _mm256_and_pd(_mm256_cmp_pd(t0, eps, _CMP_GT_OQ),
+                       _mm256_cmp_pd(t0, t1, _CMP_LT_OQ)));
+  tf = _mm256_blendv_pd(miss, tf, _mm256_cmp_pd(d, zero, _CMP_GT_OQ));
+  _mm256_storeu_pd(t, tf);
+#elif defined(__SSE2__)
+	__m128d	two = _mm_set1_pd(2.0), four = _mm_set1_pd(4.0);
+	__m128d	zero = _mm_setzero_pd(), a = _mm_loadu_pd(&pkt.a[j]);
+	__m128d	twoa = _mm_mul_pd(two, a), foura = _mm_mul_pd(four, a);
+	__m128d	eps = _mm_set1_pd(HIT_EPS), miss = _mm_set1_pd(-1.0);
+	__m128d	pcx = _mm_sub_pd(_mm_loadu_pd(&pkt.ox[j]), _mm_set1_pd(cx[i]));
+	__m128d	pcy = _mm_sub_pd(_mm_loadu_pd(&pkt.oy[j]), _mm_set1_pd(cy[i]));
+	__m128d	pcz = _mm_sub_pd(_mm_loadu_pd(&pkt.oz[j]), _mm_set1_pd(cz[i]));
+	__m128d	dx = _mm_loadu_pd(&pkt.dx[j]);
+	__m128d	dy = _mm_loadu_pd(&pkt.dy[j]);
+	__m128d	dz = _mm_loadu_pd(&pkt.dz[j]);
+	__m128d	b, c, d, sd, nb, t0, t1, tf, m;
+
+  b = _mm_add_pd(_mm_add_pd(_mm_mul_pd(pcx,dx), _mm_mul_pd(pcy,dy)),
+                 _mm_mul_pd(pcz,dz));
+  b = _mm_mul_pd(two, b);
+  c = _mm_add_pd(_mm_add_pd(_mm_mul_pd(pcx,pcx), _mm_mul_pd(pcy,pcy)),
+                 _mm_mul_pd(pcz,pcz));
+  c = _mm_sub_pd(c, _mm_set1_pd(r2[i]));
+  d = _mm_sub_pd(_mm_mul_pd(b,b), _mm_mul_pd(foura,c));
+  sd = fast ? fast_sqrt(d) : _mm_sqrt_pd(d);
+  nb = _mm_sub_pd(zero, b);
+  t0 = _mm_div_pd(_mm_sub_pd(nb, sd), twoa);
+  t1 = _mm_div_pd(_mm_add_pd(nb, sd), twoa);
+  m = _mm_and_pd(_mm_cmpgt_pd(t0, eps), _mm_cmplt_pd(t0, t1));
+  tf = _mm_or_pd(_mm_and_pd(m, t0), _mm_andnot_pd(m, t1));
+  m = _mm_cmpgt_pd(d, zero);
+  tf = _mm_or_pd(_mm_and_pd(m, tf), _mm_andnot_pd(m, miss));
+  _mm_storeu_pd(t, tf);
+#else
+  t[0] = hits(pkt.pos[j], pkt.dir[j], i);
+#endif
+}
+
+void spheres_t::closest(packet_t& pkt, const char *mask, int first,
+                        int count) const
+{
+	double	t[POOL_LANES];
+	int	end = first + count, lo = 0;
+
+  // skip the leading lanes that are masked off (missed the caller's box)
+  while(lo < pkt.n && !mask[lo]) lo++;
+  if(lo == pkt.n) return;
+  lo -= lo % POOL_LANES;
+
+  for(int i=first; i<end; i++) {
+    // slots that aren't spheres go through the virtual hits(), per lane
+    // (and in single precision every slot does, through hits())
+    if(single || !sphere(i)) {
+      for(int k=lo; k<pkt.n; k++) {
+	double	c_dist;
+
+        if(!mask[k]) continue;
+        c_dist = hits(pkt.pos[k],pkt.dir[k],i);
+        if((HIT_EPS < c_dist) && (c_dist < pkt.dist[k])) {
+          pkt.dist[k] = c_dist;
+          pkt.id[k] = i;
+        }
+      }
+      continue;
+    }
+
+    for(int j=lo; j<pkt.n; j+=POOL_LANES) {
+      lanes(pkt, i, j, t);
+
+      // same acceptance test as the linear scan
+      for(int k=0; k<POOL_LANES && j+k<pkt.n; k++) {
+        if(mask[j+k] && (HIT_EPS < t[k]) && (t[k] < pkt.dist[j+k])) {
+          pkt.dist[j+k] = t[k];
+          pkt.id[j+k] = i;
+        }
+      }
+    }
+  }
+}
+
+void planes_t::build(const std::vector<object_t* >& unbounded)
+{
+  objs = unbounded;
+  nx.assign(objs.size(), 0.0);
+  ny.assign(objs.size(), 0.0);
+  nz.assign(objs.size(), 0.0);
+  ndotq.assign(objs.size(), 0.0);
+  isplane.assign(objs.size(), 0);
+
+  for(int i=0; i<(int)objs.size(); i++) {
+    if(objs[i]->gettype() == "plane") {
+	plane_t	*pln = (plane_t *)objs[i];
+	vec_t	unit = pln->getunit();
+
+      nx[i] = unit[0];
+      ny[i] = unit[1];
+      nz[i] = unit[2];
+      ndotq[i] = pln->getndotq();
+      isplane[i] = 1;
+    }
+  }
+}
+
+double planes_t::hits(const vec_t& pos, const vec_t& dir, int i) const
+{
+	double	ndotd, ndotb, t, precision=0.000001;
+
+  if(!isplane[i]) return objs[i]->hits(pos,dir);
+  if(single) {
+	float	fd, fb, ft;
+
+    fd = (float)dir[0]*(float)nx[i] + (float)dir[1]*(float)ny[i] +
+         (float)dir[2]*(float)nz[i];
+    if(fabsf(fd) < (float)precision) return(-1);
+
+    fb = (float)pos[0]*(float)nx[i] + (float)pos[1]*(float)ny[i] +
+         (float)pos[2]*(float)nz[i];
+    ft = ((float)ndotq[i] - fb) / fd;
+    if(ft <= 0) return(-1);
+    if((float)pos[2] + ft * (float)dir[2] > 0.0f) return(-1);
+
+    return(ft);
+  }
+
+  // same arithmetic as plane_t::hits, see there
+  ndotd = dir[0]*nx[i] + dir[1]*ny[i] + dir[2]*nz[i];
+  if(fabs(ndotd) < precision) return(-1);
+
+  ndotb = pos[0]*nx[i] + pos[1]*ny[i] + pos[2]*nz[i];
+  t = (ndotq[i] - ndotb) / ndotd;
+  if(t <= 0) return(-1);
+  if(pos[2] + t * dir[2] > 0.0) return(-1);
+
+  return(t);
+}
+
+void planes_t::closest(const vec_t& pos, const vec_t& dir,
+                       double& dist, int& id) const
+{
+	double	t;
+
+  for(int i=0; i<(int)objs.size(); i++) {
+    if((t = hits(pos,dir,i)) < 0) continue;
+
+    if((HIT_EPS < t) && (t < dist)) {
+      dist = t;
+      id = i;
+    }
+  }
+}
+
+int planes_t::any(const vec_t& pos, const vec_t& dir, double maxdist) const
+{
+	double	t;
+
+  for(int i=0; i<(int)objs.size(); i++) {
+    t = hits(pos,dir,i);
+    if((HIT_EPS < t) && (t < maxdist)) return i;
+  }
+
+  return(-1);
+}
@@ -0,0 +1,122 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <vector>
+
+// forward declarations
+class packet_t;
+
+// lane width of the batch intersection kernels (doubles per register,
+// twice as many floats in single precision)
+#if defined(__AVX__)
+#define POOL_LANES	4
+#define POOL_FLANES	8
+#elif defined(__SSE2__)
+#define POOL_LANES	2
+#define POOL_FLANES	4
+#else
+#define POOL_LANES	1
+#define POOL_FLANES	1
+#endif
+
+// compiled, type-homogeneous copy of the bounded objects of a model, laid
+// out as structure-of-arrays so one ray can be tested against a batch of
+// spheres at a time; slots follow the acceleration structure's object order
+// and the parse-time objects are only kept (cold) for normals and materials.
+// in single precision the hot data and the kernels are float (only the
+// distances handed back are double)
+class spheres_t
+{
+  public:
+  // constructors
+  spheres_t() : \
+	generic(0), \
+	single(false), \
+	fast(false) \
+	{ };
+
+  // copy constructor (default member copies ok)
+  // destructors (default ok, objects are owned by the model)
+
+  // members
+  int		size() const		{ return (int)objs.size(); }
+  object_t*	getobj(int i) const	{ return objs[i]; }
+  bool		getsingle() const	{ return single; }
+  void		setsingle(bool s)	{ single = s; }
+  void		setfast(bool f)		{ fast = f; }
+
+  void		build(const std::vector<object_t* >& prims);
+
+  // closest hit among slots [first,first+count), updates dist and id
+  void		closest(const vec_t& pos, const vec_t& dir, int first,
+		        int count, double& dist, int& id) const;
+  // any hit among slots [first,first+count) closer than maxdist, -1 if none
+  int		any(const vec_t& pos, const vec_t& dir, int first,
+		    int count, double maxdist) const;
+  // distance to a single slot, -1 on a miss
+  double	hits(const vec_t& pos, const vec_t& dir, int i) const;
+  // closest hit among slots [first,first+count) for each lane of a packet
+  // with a nonzero mask, updates the lane's dist and id
+  void		closest(packet_t& pkt, const char *mask, int first,
+		        int count) const;
+
+  private:
+  void		batch(const vec_t& pos, const vec_t& dir, double a,
+		      int i, double *t) const;
+  void		lanes(const packet_t& pkt, int i, int j, double *t) const;
+  void		fbatch(const vec_t& pos, const vec_t& dir, int i,
+		       double *t) const;
+  double	fhits(const vec_t& pos, const vec_t& dir, int i) const;
+  bool		sphere(int i) const
+			{ return single ? fr2[i] != -HUGE_VALF : r2[i] != -HUGE_VAL; }
+
+  // hot data: sphere geometry, padded to a multiple of POOL_LANES
+  std::vector<double>		cx, cy, cz;	// centers
+  std::vector<double>		r2;		// radius squared, -inf if not
+						// a sphere (never hits)
+  // same in single precision, padded to a multiple of POOL_FLANES
+  std::vector<float>		fx, fy, fz, fr2;
+
+  // cold data
+  std::vector<object_t* >	objs;		// parse-time objects
+  int				generic;	// count of non-sphere slots
+  bool				single;		// float hot data and kernels
+  bool				fast;		// approximate sqrt (fastmath.h)
+};
+
+// compiled copy of the unbounded objects (planes), same idea as spheres_t
+class planes_t
+{
+  public:
+  // constructors
+  planes_t() : \
+	single(false) \
+	{ };
+
+  // members
+  int		size() const		{ return (int)objs.size(); }
+  object_t*	getobj(int i) const	{ return objs[i]; }
+  void		setsingle(bool s)	{ single = s; }
+
+  void		build(const std::vector<object_t* >& unbounded);
+
+  // closest hit among all planes, updates dist and id
+  void		closest(const vec_t& pos, const vec_t& dir,
+		        double& dist, int& id) const;
+  // any hit closer than maxdist, -1 if none
+  int		any(const vec_t& pos, const vec_t& dir, double maxdist) const;
+  // distance to a single plane, -1 on a miss
+  double	hits(const vec_t& pos, const vec_t& dir, int i) const;
+
+  private:
+  // hot data: unit normal and N . q per plane
+  std::vector<double>		nx, ny, nz;
+  std::vector<double>		ndotq;
+
+  // cold data
+  std::vector<object_t* >	objs;
+  std::vector<char>		isplane;	// false: fall back to hits()
+  bool				single;		// float arithmetic
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef PRECISION_H
+#define PRECISION_H
+
+#include <cstring>
+
+// smallest distance along a ray at which a hit counts; keeps a ray from
+// hitting the surface it starts on (used by all intersection tests)
+#define HIT_EPS		0.00001
+
+// robust ray origin for a secondary ray leaving hit point p (normal n)
+// in direction d: p is pushed off the surface by a few float ulps of its
+// own coordinates (Waechter & Binder, Ray Tracing Gems ch. 6), which
+// covers the error of float intersection far better than HIT_EPS alone
+static inline vec_t offset_origin(const vec_t& p, const vec_t& n, const vec_t& d)
+{
+	const float	origin = 1.0f / 32.0f;
+	const float	float_scale = 1.0f / 65536.0f;
+	const float	int_scale = 256.0f;
+	vec_t		result;
+	float		f, side = n.dot(d) < 0.0 ? -1.0f : 1.0f;
+	int		i, of;
+
+  for(int a=0; a<3; a++) {
+    f = (float)p[a];
+    of = (int)(int_scale * side * (float)n[a]);
+
+    // near the origin ulps get too small, use a fixed offset there
+    if(fabsf(f) < origin) {
+      result[a] = f + float_scale * side * (float)n[a];
+      continue;
+    }
+    memcpy(&i, &f, sizeof(f));
+    i += f < 0.0f ? -of : of;
+    memcpy(&f, &i, sizeof(f));
+    result[a] = f;
+  }
+
+  return result;
+}
+
+#endif
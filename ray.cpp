@@ -5,14 +5,24 @@
 #include <cassert>
 #include <cmath>
 
+#include "simd.h"
 #include "vector.h"
+#include "fastmath.h"
 #include "pixel.h"
+#include "aabb.h"
 #include "camera.h"
+#include "options.h"
 #include "light.h"
 #include "material.h"
 #include "object.h"
 #include "list.h"
 #include "plane.h"
+#include "pool.h"
+#include "accel.h"
+#include "bvh.h"
+#include "grid.h"
+#include "tiles.h"
+#include "lightgrid.h"
 #include "model.h"
 #include "photon.h"
 #include "ray.h"
@@ -22,317 +32,47 @@ void ray_t::trace(model_t&		model,
                   rgb_t<double>&	color,
 		  int bounce)
 {
-	// (static) object properties
 	object_t			*obj=NULL;
-	rgb_t<double>			ambient, diffuse, specular;
-	material_t			*mat;
 	vec_t				hit,N;	   // hit point and normal
-	float				alpha, ior;
-
-	// light and illumination model variables
-	light_t				*lgt=NULL;
-	vec_t				L,V,R,H;
-	rgb_t<double>			I_d, I_s;
-	double				r,ndotl=0.0,n=32.0;
-	list_t<light_t* >::iterator	litr;
 
 // prevent infinite loops
-  if(bounce > 5) return;
+  if(bounce > RAY_DEPTH) return;
 
   // get closest object, if any
   if(!(obj = model.find_closest(pos,dir,dis,hit,N)) || dis > MAX_DIST)
     return;
 
-  // if hit distance valid, compute color at surface
-  if(dis > 0) {
-
-    // get object material properties
-    if((mat = model.getmaterial(obj->getmaterial())) != NULL) {
-      ambient = mat->getamb();
-      diffuse = mat->getdiff();
-      specular = mat->getspec();
-      alpha = mat->getalpha();
-      ior = mat->getior();
-    }
-
-    // ambient color
-    color += 1.0/dis * ambient;			// ambient scaled by ray dist
-
-    // clamp resultant color
-    color.clamp(0.0,1.0);
-
-    // view direction (direction from hit point to camera)
-    V = -dir;
-
-    // diffuse component from each light...
-    if(!diffuse.iszero()) {
-      for(litr = model.lgts.begin(); litr != model.lgts.end(); litr++) {
-        // pointer to light
-        lgt = (light_t *)*litr;
-  
-        // light direction and distance
-        L = lgt->getlocation() - hit;
-        r = L.len();				// distance to light
-        L = L.norm();				// dir to light
-  
-        // angle with light
-        ndotl = N.dot(L);
-  
-        // check visibility wrt light
-        if(0.0 < ndotl && ndotl < 1.0) {
-          // light color scaled by N . L
-          I_d = 1.0/r * ndotl * lgt->getcolor();
-  
-          // add in diffuse contribution from light scaled by material property
-          color += (I_d * diffuse);
-        }
-      }
-  
-      // clamp resultant color
-      color.clamp(0.0,1.0);
-    }
-
-    // reflection
-    if(!specular.iszero()) {
-	rgb_t<double>	refcolor;
-	vec_t		r = dir.reflect(N);
-        ray_t		*reflection = new ray_t(hit,r,dis);
-
-      // trace the reflection
-      reflection->trace(model,refcolor, (bounce + 1));
-      delete reflection;
-
-      // composite surface color: blending baesd on surface properties
-      // (note that diffuse + specular should add up to 1)
-      color  = (diffuse * color) + (specular * refcolor);
-
-      // clamp resultant color
-      color.clamp(0.0,1.0);
-    }
-
-    // transmission
-    if(alpha > 0.0) {
-	rgb_t<double>	transmitted_color;
-	vec_t		t;
-
-        // decide which N about which to refract
-	if(dir.dot(N) < .00001)
-		{ t = dir.refract(N, ior); }
-	else
-		{ t = dir.refract( -N, (1/ior) ); }; 
-
-       ray_t		*refraction = new ray_t(hit,t,dis);
-
-      // trace the refraction
-      refraction->trace(model,transmitted_color, (bounce + 1));
-      delete refraction;
-
-      // composite surface color: blending baesd on surface properties
-      // (note that diffuse + specular should add up to 1)
-      color  = (color * (1.0 - alpha)) + (transmitted_color * alpha);
-
-      // clamp resultant color
-      color.clamp(0.0,1.0);
-    }
-
-    // specular highlights
-    if(!specular.iszero()) {
-
-      // add in specular highlight from each light...
-      for(litr = model.lgts.begin(); litr != model.lgts.end(); litr++) {
-        // pointer to light
-        lgt = (light_t *)*litr;
-
-        // light direction and distance
-        L = lgt->getlocation() - hit;
-        r = L.len();				// distance to light
-        L = L.norm();				// dir to light
-
-        // angle with light
-        ndotl = N.dot(L);
-
-        // check visibility wrt light
-        if(0.0 < ndotl && ndotl < 1.0) {
-          // specular reflection direction (and bisector)
-          R = L.reflect(N);
-          // bisector (not used)
-          H = (0.5 * (L + V)).norm();
-
-          // light color scaled by (R . V)^n
-          I_s = 1.0/r * pow(R.dot(V),n) * lgt->getcolor();
-  
-          // add in specular contribution from light scaled by material property
-          color += (I_s * specular);
-        }
-
-        // clamp resultant color
-        color.clamp(0.0,1.0);
-      }
-    }
-  }
+  shade(model,color,bounce,obj,hit,N);
 }
 
 
 void ray_t::trace(model_t&		model,
                   rgb_t<double>&	color,
 		  int bounce,
-		  kdtree_t<photon_t, photon_t*, photon_c> kdtree)
+		  const kdtree_t<photonrec_t, photonrec_t, photonrec_c>&,
+		  int tile)
 {
-	// (static) object properties
 	object_t			*obj=NULL;
-	rgb_t<double>			ambient, diffuse, specular;
-	material_t			*mat;
 	vec_t				hit,N;	   // hit point and normal
-	float				alpha, ior;
-
-	// light and illumination model variables
-	light_t				*lgt=NULL;
-	vec_t				L,V,R,H;
-	rgb_t<double>			I_d, I_s;
-	double				r,ndotl=0.0,n=32.0;
-	list_t<light_t* >::iterator	litr;
-
-	double				radius(0.0);
-	std::vector<photon_t* >		knearest;
 
 // prevent infinite loops
-  if(bounce > 5) return;
+  if(bounce > RAY_DEPTH) return;
 
   // get closest object, if any
-  if(!(obj = model.find_closest(pos,dir,dis,hit,N)) || dis > MAX_DIST)
+  if(!(obj = model.find_closest(pos,dir,dis,hit,N,tile)) || dis > MAX_DIST)
     return;
 
-  // if hit distance valid, compute color at surface
-  if(dis > 0) {
-
-    // get object material properties
-    if((mat = model.getmaterial(obj->getmaterial())) != NULL) {
-      ambient = mat->getamb();
-      diffuse = mat->getdiff();
-      specular = mat->getspec();
-      alpha = mat->getalpha();
-      ior = mat->getior();
-    }
-
-    // ambient color
-    color += 1.0/dis * ambient;			// ambient scaled by ray dist
-
-    // clamp resultant color
-    color.clamp(0.0,1.0);
-
-    // view direction (direction from hit point to camera)
-    V = -dir;
-
-    // diffuse component from each light...
-    if(!diffuse.iszero()) {
-      for(litr = model.lgts.begin(); litr != model.lgts.end(); litr++) {
-        // pointer to light
-        lgt = (light_t *)*litr;
-  
-        // light direction and distance
-        L = lgt->getlocation() - hit;
-        r = L.len();				// distance to light
-        L = L.norm();				// dir to light
-  
-        // angle with light
-        ndotl = N.dot(L);
-  
-        // check visibility wrt light
-        if(0.0 < ndotl && ndotl < 1.0) {
-          // light color scaled by N . L
-          I_d = 1.0/r * ndotl * lgt->getcolor();
-  
-          // add in diffuse contribution from light scaled by material property
-          color += (I_d * diffuse);
-        }
-      }
-  
-      // clamp resultant color
-      color.clamp(0.0,1.0);
-    }
-
-    // reflection
-    if(!specular.iszero()) {
-	rgb_t<double>	refcolor;
-	vec_t		r = dir.reflect(N);
-        ray_t		*reflection = new ray_t(hit,r,dis);
-
-      // trace the reflection
-      reflection->trace(model,refcolor, (bounce + 1), kdtree);
-      delete reflection;
-
-      // composite surface color: blending baesd on surface properties
-      // (note that diffuse + specular should add up to 1)
-      color  = (diffuse * color) + (specular * refcolor);
+  shade(model,color,bounce,obj,hit,N);
 
-      // clamp resultant color
-      color.clamp(0.0,1.0);
-    }
-
-    // transmission
-    if(alpha > 0.0) {
-	rgb_t<double>	transmitted_color;
-	vec_t		t;
-
-        // decide which N about which to refract
-	if(dir.dot(N) < .00001)
-		{ t = dir.refract(N, ior); }
-	else
-		{ t = dir.refract( -N, (1/ior) ); }; 
-
-       ray_t		*refraction = new ray_t(hit,t,dis);
-
-      // trace the refraction
-      refraction->trace(model,transmitted_color, (bounce + 1), kdtree);
-      delete refraction;
-
-      // composite surface color: blending baesd on surface properties
-      // (note that diffuse + specular should add up to 1)
-      color  = (color * (1.0 - alpha)) + (transmitted_color * alpha);
-
-      // clamp resultant color
-      color.clamp(0.0,1.0);
-    }
-
-    // specular highlights
-    if(!specular.iszero()) {
-
-      // add in specular highlight from each light...
-      for(litr = model.lgts.begin(); litr != model.lgts.end(); litr++) {
-        // pointer to light
-        lgt = (light_t *)*litr;
-
-        // light direction and distance
-        L = lgt->getlocation() - hit;
-        r = L.len();				// distance to light
-        L = L.norm();				// dir to light
-
-        // angle with light
-        ndotl = N.dot(L);
-
-        // check visibility wrt light
-        if(0.0 < ndotl && ndotl < 1.0) {
-          // specular reflection direction (and bisector)
-          R = L.reflect(N);
-          // bisector (not used)
-          H = (0.5 * (L + V)).norm();
-
-          // light color scaled by (R . V)^n
-          I_s = 1.0/r * pow(R.dot(V),n) * lgt->getcolor();
-  
-          // add in specular contribution from light scaled by material property
-          color += (I_s * specular);
-        }
-
-        // clamp resultant color
-        color.clamp(0.0,1.0);
-      }
-    }
-  }
+  // flux gather from the photon map, disabled (the map is not read)
 /*
+	double				radius(INFINITY), dist2[20];
+	const photonrec_t		*knearest[20];
+	int				found;
+
 	// flux computation
-        photon_t *query = new photon_t(hit, vec_t(0.0,0.0,0.0), 0.0);
-	kdtree.knn(*query, knearest, radius, 20);
+	photonrec_t query(hit);
+	found = kdtree.knn(query, knearest, dist2, 20, radius);
 	
 	rgb_t<double> flux(0.0,0.0,0.0);
 	rgb_t<double> tempcolor(0.0,0.0,0.0);
@@ -341,7 +81,7 @@ void ray_t::trace(model_t&		model,
 	vec_t	temp_dir;
 
 
-	for(int i = 0; i < 20; i++)
+	for(int i = 0; i < found; i++)
 	{
 		temp_pow = knearest[i]->get_power();
 		temp_dir = knearest[i]->get_dir();
@@ -369,3 +109,330 @@ void ray_t::trace(model_t&		model,
 	color.clamp(0.0,1.0);
 */
 }
+
+
+// uniform in [0,1) from a per-ray xorshift state
+static double roulette_draw(unsigned& seed)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+
+  return(seed / 4294967296.0);
+}
+
+// roulette draws are seeded per ray: a primary ray from its direction
+// (fnv-1a over its bytes), a secondary ray from its parent's seed and
+// which of its children it is. renders then repeat whatever the thread
+// schedule, and whatever order the rays are traced in
+unsigned ray_t::rootseed(const vec_t& d)
+{
+	unsigned		h = 2166136261u;
+	const unsigned char	*b;
+
+  for(int i=0; i<3; i++) {
+    b = (const unsigned char *)&d[i];
+    for(int j=0; j<(int)sizeof(double); j++) h = (h ^ b[j]) * 16777619u;
+  }
+
+  return(h ? h : 1);
+}
+
+static unsigned child_seed(unsigned seed, unsigned branch)
+{
+  seed = (seed ^ branch) * 16777619u;
+
+  return(seed ? seed : 1);
+}
+
+// decide whether the secondary ray in c is worth tracing. with a cutoff
+// (off by default) a ray whose throughput is under it isn't traced; it
+// could only change its pixel a little, but even that can tip an 8 bit
+// value, so scenes opt in. past the roulette depth a ray survives with
+// probability equal to its throughput and its color then counts
+// 1/throughput times
+bool ray_t::keep(model_t& model, frame_t& c)
+{
+	double	w = c.weight[0];
+
+  if(c.weight[1] > w) w = c.weight[1];
+  if(c.weight[2] > w) w = c.weight[2];
+
+  c.scale = 1.0;
+  if(w < model.getcutoff()) return false;
+
+  if(model.getroulette() > 0 && c.bounce >= model.getroulette() && w < 1.0) {
+    if(roulette_draw(c.seed) >= w) return false;
+    c.scale = 1.0 / w;
+  }
+
+  return true;
+}
+
+// the reflected ray of frame f, in c
+void ray_t::reflection(model_t& model, frame_t& f, frame_t& c)
+{
+  c.dir = f.dir.reflect(f.N);
+  c.pos = model.origin(f.hit,f.N,c.dir);
+  c.dis = f.dis;
+  c.bounce = f.bounce + 1;
+  c.seed = child_seed(f.seed,1);
+
+  // the reflected color ends up scaled by specular, then by (1 - alpha) if
+  // the surface also transmits
+  c.weight = f.weight * f.mat->getspec();
+  if(f.cls & MAT_TRANSMIT) c.weight *= (1.0 - f.mat->getalpha());
+}
+
+// the refracted ray of frame f, in c
+void ray_t::refraction(model_t& model, frame_t& f, frame_t& c)
+{
+  // decide which N about which to refract
+  if(f.dir.dot(f.N) < .00001)
+    c.dir = f.dir.refract(f.N, f.mat->getior());
+  else
+    c.dir = f.dir.refract( -f.N, (1/f.mat->getior()) );
+
+  c.pos = model.origin(f.hit,f.N,c.dir);
+  c.dis = f.dis;
+  c.bounce = f.bounce + 1;
+  c.seed = child_seed(f.seed,2);
+  c.weight = f.weight * (double)f.mat->getalpha();
+}
+
+// blend the color ret of frame f's reflected ray into it
+void ray_t::reflected(frame_t& f, const rgb_t<double>& ret)
+{
+  // composite surface color: blending baesd on surface properties
+  // (note that diffuse + specular should add up to 1)
+  f.color  = (f.mat->getdiff() * f.color) + (f.mat->getspec() * ret);
+
+  // clamp resultant color
+  f.color.clamp(0.0,1.0);
+}
+
+// blend the color ret of frame f's refracted ray into it
+void ray_t::refracted(frame_t& f, const rgb_t<double>& ret)
+{
+  // composite surface color: blending baesd on surface properties
+  // (note that diffuse + specular should add up to 1)
+  f.color  = (f.color * (1.0 - f.mat->getalpha())) +
+             (ret * (double)f.mat->getalpha());
+
+  // clamp resultant color
+  f.color.clamp(0.0,1.0);
+}
+
+// last step of frame f's shading, ret is the color it hands back
+void ray_t::finish(model_t& model, frame_t& f, rgb_t<double>& ret)
+{
+  // specular highlights
+  highlights(model,f);
+
+  ret = f.color;
+  if(f.scale != 1.0) ret *= f.scale;
+}
+
+// open a frame for the ray in f (pos, dir, dis, bounce set): find its
+// closest hit and do the local shading; false if the ray hits nothing (its
+// color is black then)
+bool ray_t::open(model_t& model, frame_t& f)
+{
+  // prevent infinite loops
+  if(f.bounce > RAY_DEPTH) return false;
+
+  // get closest object, if any
+  if(!(f.obj = model.find_closest(f.pos,f.dir,f.dis,f.hit,f.N)) ||
+     f.dis > MAX_DIST)
+    return false;
+
+  f.color.zero();
+  local(model,f);
+
+  return true;
+}
+
+// the local shading for the hit material's class
+void ray_t::local(model_t& model, frame_t& f)
+{
+	static void (ray_t::*const tab[MAT_CLASSES])(model_t&, frame_t&) = {
+	  &ray_t::shade_local<0>, &ray_t::shade_local<1>,
+	  &ray_t::shade_local<2>, &ray_t::shade_local<3>,
+	  &ray_t::shade_local<4>, &ray_t::shade_local<5>,
+	  &ray_t::shade_local<6>, &ray_t::shade_local<7> };
+
+  f.stage = SHADE_REFLECT;
+
+  // object material, resolved at load
+  f.mat = f.obj->getmat();
+  f.cls = f.mat->getclass();
+
+  (this->*tab[f.cls])(model,f);
+}
+
+// local shading of frame f for material class C: ambient, then one pass
+// over the lights that count at the hit for both the diffuse term (added
+// now) and the specular highlights (kept for the end of the frame's
+// shading); the terms the class doesn't have are compiled out
+template <int C>
+void ray_t::shade_local(model_t& model, frame_t& f)
+{
+	const material_t		&mat = *f.mat;
+	const lightgrid_t		&lights = model.lights;
+	vec_t				L,V,R;
+	rgb_t<double>			I_d,I_s;
+	double				r,ndotl=0.0,n=32.0;
+	const int			*idx;
+	int				li,nl;		// light index, count
+
+  f.highlight.zero();
+
+  // ambient color
+  f.color.madd(mat.getamb(), 1.0/f.dis);	// ambient scaled by ray dist
+
+  // clamp resultant color
+  f.color.clamp(0.0,1.0);
+
+  if(!(C & (MAT_DIFFUSE | MAT_SPECULAR))) return;
+
+  // view direction (direction from hit point to camera)
+  V = -f.dir;
+
+  // diffuse and specular component from each light...
+  nl = lights.lookup(f.hit,idx);
+  for(int i=0; i<nl; i++) {
+    li = idx[i];
+
+    L = (lights.getlocation(li) - f.hit).norm(r);	// dir and distance to light
+
+    // too far off to count
+    if(lights.culled(li,r)) continue;
+
+    // angle with light
+    ndotl = f.N.dot(L);
+
+    // check visibility wrt light (facing it, nothing in between)
+    if(0.0 < ndotl && ndotl < 1.0 &&
+       !model.occluded(model.origin(f.hit,f.N,L),L,r,li)) {
+      if(C & MAT_DIFFUSE) {
+        // light color scaled by N . L
+        I_d = 1.0/r * ndotl * lights.getcolor(li);
+
+        // add in diffuse contribution from light scaled by material property
+        f.color.madd(I_d, mat.getdiff());
+      }
+
+      if(C & MAT_SPECULAR) {
+        // specular reflection direction
+        R = L.reflect(f.N);
+
+        // light color scaled by (R . V)^n
+        // (n is a whole number, the fast tier multiplies it out)
+        I_s = 1.0/r * (model.fastmath() ? fast_pow(R.dot(V),(int)n) :
+                                          pow(R.dot(V),n)) * lights.getcolor(li);
+
+        // specular contribution from light scaled by material property
+        f.highlight.madd(I_s, mat.getspec());
+      }
+    }
+  }
+
+  // clamp resultant color
+  if(C & MAT_DIFFUSE) f.color.clamp(0.0,1.0);
+}
+
+// specular highlights of frame f, the last step of its shading: the
+// contributions are all positive so adding their sum and clamping once
+// is clamping after each
+void ray_t::highlights(model_t&, frame_t& f)
+{
+  if(!(f.cls & MAT_SPECULAR)) return;
+
+  f.color += f.highlight;
+
+  // clamp resultant color
+  f.color.clamp(0.0,1.0);
+}
+
+// compute the color at a known hit point (obj, hit, N) of this ray, which
+// has travelled dis so far. secondary rays don't recurse: each ray is a
+// frame on a fixed stack that is shaded in stages, and a frame waiting on
+// its reflection or refraction resumes when that frame is done and hands
+// back its color (same order of operations, so the same result, as
+// shading them recursively)
+void ray_t::shade(model_t&		model,
+                  rgb_t<double>&	color,
+		  int bounce,
+		  object_t			*obj,
+		  vec_t&			hit,
+		  vec_t&			N)
+{
+	frame_t				stack[RAY_DEPTH + 2];
+	rgb_t<double>			ret;	// color of the last frame done
+	int				top = 0;
+	bool				spawned;
+
+  // if hit distance valid, compute color at surface
+  if(dis <= 0 || bounce > RAY_DEPTH) return;
+
+  // the root frame is this ray, shaded on top of the color passed in
+  stack[0].pos = pos;
+  stack[0].dir = dir;
+  stack[0].dis = dis;
+  stack[0].bounce = bounce;
+  stack[0].obj = obj;
+  stack[0].hit = hit;
+  stack[0].N = N;
+  stack[0].color = color;
+  stack[0].weight = rgb_t<double>(1.0,1.0,1.0);
+  stack[0].scale = 1.0;
+  stack[0].seed = rootseed(dir);
+  local(model,stack[0]);
+
+  while(top >= 0) {
+	frame_t&	f = stack[top];
+	frame_t&	c = stack[top + 1];		// next secondary ray
+
+    spawned = false;
+    switch(f.stage) {
+      case SHADE_REFLECT:
+        // reflection
+        if(!(f.cls & MAT_SPECULAR)) { f.stage = SHADE_REFRACT; break; }
+        f.stage = SHADE_REFLECTED;
+        ret.zero();
+        if(f.bounce + 1 > RAY_DEPTH) break;
+        reflection(model,f,c);
+        spawned = keep(model,c) && open(model,c);
+        break;
+
+      case SHADE_REFLECTED:
+        reflected(f,ret);
+        f.stage = SHADE_REFRACT;
+        break;
+
+      case SHADE_REFRACT:
+        // transmission
+        if(!(f.cls & MAT_TRANSMIT)) { f.stage = SHADE_LIGHTS; break; }
+        f.stage = SHADE_REFRACTED;
+        ret.zero();
+        if(f.bounce + 1 > RAY_DEPTH) break;
+        refraction(model,f,c);
+        spawned = keep(model,c) && open(model,c);
+        break;
+
+      case SHADE_REFRACTED:
+        refracted(f,ret);
+        f.stage = SHADE_LIGHTS;
+        break;
+
+      case SHADE_LIGHTS:
+        // specular highlights, then this frame is done
+        finish(model,f,ret);
+        top--;
+        break;
+    }
+    if(spawned) top++;
+  }
+
+  color = ret;
+}
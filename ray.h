@@ -8,14 +8,50 @@
 // forward declarations
 template <typename T, typename P, typename C> 
 class kdtree_t;
-class photon_t;
-class photon_c;
+class photonrec_t;
+class photonrec_c;
+class object_t;
+class material_t;
 
 
 #define MAX_DIST 100
+#define RAY_DEPTH 5	// deepest bounce traced (primary rays are 0)
+
 class model_t;
+class wavefront_t;
 class ray_t
 {
+  friend class wavefront_t;
+
+  private:
+  // shading stages of a frame, in order
+  enum { SHADE_REFLECT, SHADE_REFLECTED, SHADE_REFRACT, SHADE_REFRACTED,
+         SHADE_LIGHTS };
+
+  // one ray being shaded: the ray and its hit, its material, its color so
+  // far, and the stage it got to (see shade()). weight is the throughput,
+  // how much of the frame's color makes it to the pixel at most, and scale
+  // what its color counts for when it hands it back (russian roulette),
+  // seed the state of its roulette draws
+  struct frame_t
+  {
+	vec_t		pos, dir;
+	double		dis;
+	int		bounce;
+	int		stage;
+	object_t	*obj;
+	vec_t		hit, N;
+	const material_t *mat;
+	int		cls;		// mat's class (MAT_* bits)
+	rgb_t<double>	color, weight;
+	rgb_t<double>	highlight;	// specular, added last
+	double		scale;
+	unsigned	seed;
+
+	frame_t() : dis(0.0), bounce(0), stage(0), obj(NULL), mat(NULL), cls(0),
+		    scale(1.0), seed(1) { };
+  };
+
   public:
   // constructors (overloaded)
   ray_t() : \
@@ -49,13 +85,28 @@ class ray_t
 	}
 
   // methods
-  void trace(model_t&,rgb_t<double>&, int bounce, kdtree_t<photon_t, photon_t*, photon_c> kdtree);
+  void trace(model_t&,rgb_t<double>&, int bounce, const kdtree_t<photonrec_t, photonrec_t, photonrec_c>& kdtree, int tile=-1);
   void trace(model_t&,rgb_t<double>&, int bounce);
+  void shade(model_t&,rgb_t<double>&, int bounce, object_t *obj,
+             vec_t& hit, vec_t& N);
 
   // destructors (default ok, no 'new' in constructor)
   ~ray_t()
 	{ };
 
+  private:
+  static unsigned rootseed(const vec_t&);
+  bool keep(model_t&, frame_t&);
+  bool open(model_t&, frame_t&);
+  void reflection(model_t&, frame_t&, frame_t&);
+  void refraction(model_t&, frame_t&, frame_t&);
+  void reflected(frame_t&, const rgb_t<double>&);
+  void refracted(frame_t&, const rgb_t<double>&);
+  void finish(model_t&, frame_t&, rgb_t<double>&);
+  void local(model_t&, frame_t&);
+  void highlights(model_t&, frame_t&);
+  template <int C> void shade_local(model_t&, frame_t&);
+
   protected:
   double   dis;	// distance
   vec_t    pos;	// position
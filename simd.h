@@ -0,0 +1,191 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// storage width of the 3-component math types (vec3_t, rgb_t): float and
+// double are padded to 4 lanes so one (or two) registers hold a vector,
+// anything else (e.g., the uchar image pixels) stays packed at 3
+template <typename T>
+struct simd_t		{ enum { lanes = 3 }; };
+template <>
+struct simd_t<float>	{ enum { lanes = 4 }; };
+template <>
+struct simd_t<double>	{ enum { lanes = 4 }; };
+
+// elementwise kernels on those arrays: r = -a, a + b, a - b, a * b, a * s,
+// a / s, r + a * s, r + a * b (the last two are the fused multiply-adds,
+// done as separate multiply and add so results match the plain operators
+// bit for bit) and the dot product of the first 3 lanes, summed in lane
+// order. the generic versions loop, float and double use SSE/AVX. the pad
+// lane only ever holds 0 op 0 and is never read back
+template <typename T>
+inline void simd_neg(T *r, const T *a)
+{ for(int i=0; i<3; i++) r[i] = -a[i]; }
+template <typename T>
+inline void simd_add(T *r, const T *a, const T *b)
+{ for(int i=0; i<3; i++) r[i] = a[i] + b[i]; }
+template <typename T>
+inline void simd_sub(T *r, const T *a, const T *b)
+{ for(int i=0; i<3; i++) r[i] = a[i] - b[i]; }
+template <typename T>
+inline void simd_mul(T *r, const T *a, const T *b)
+{ for(int i=0; i<3; i++) r[i] = a[i] * b[i]; }
+template <typename T>
+inline void simd_scale(T *r, const T *a, T s)
+{ for(int i=0; i<3; i++) r[i] = a[i] * s; }
+template <typename T>
+inline void simd_div(T *r, const T *a, T s)
+{ for(int i=0; i<3; i++) r[i] = a[i] / s; }
+template <typename T>
+inline void simd_madd(T *r, const T *a, T s)
+{ for(int i=0; i<3; i++) r[i] += a[i] * s; }
+template <typename T>
+inline void simd_madd(T *r, const T *a, const T *b)
+{ for(int i=0; i<3; i++) r[i] += a[i] * b[i]; }
+template <typename T>
+inline T simd_dot(const T *a, const T *b)
+{
+	T	s=0.0;
+
+  for(int i=0; i<3; i++) s += a[i] * b[i];
+
+  return(s);
+}
+
+#if defined(__AVX__)
+inline void simd_neg(double *r, const double *a)
+{ _mm256_storeu_pd(r, _mm256_xor_pd(_mm256_loadu_pd(a), _mm256_set1_pd(-0.0))); }
+inline void simd_add(double *r, const double *a, const double *b)
+{ _mm256_storeu_pd(r, _mm256_add_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b))); }
+inline void simd_sub(double *r, const double *a, const double *b)
+{ _mm256_storeu_pd(r, _mm256_sub_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b))); }
+inline void simd_mul(double *r, const double *a, const double *b)
+{ _mm256_storeu_pd(r, _mm256_mul_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b))); }
+inline void simd_scale(double *r, const double *a, double s)
+{ _mm256_storeu_pd(r, _mm256_mul_pd(_mm256_loadu_pd(a), _mm256_set1_pd(s))); }
+inline void simd_div(double *r, const double *a, double s)
+{ _mm256_storeu_pd(r, _mm256_div_pd(_mm256_loadu_pd(a), _mm256_set1_pd(s))); }
+inline void simd_madd(double *r, const double *a, double s)
+{
+  _mm256_storeu_pd(r, _mm256_add_pd(_mm256_loadu_pd(r),
+                       _mm256_mul_pd(_mm256_loadu_pd(a), _mm256_set1_pd(s))));
+}
+inline void simd_madd(double *r, const double *a, const double *b)
+{
+  _mm256_storeu_pd(r, _mm256_add_pd(_mm256_loadu_pd(r),
+                       _mm256_mul_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b))));
+}
+inline double simd_dot(const double *a, const double *b)
+{
+	double	p[4], s=0.0;
+
+  _mm256_storeu_pd(p, _mm256_mul_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b)));
+  s += p[0]; s += p[1]; s += p[2];
+
+  return(s);
+}
+#elif defined(__SSE2__)
+inline void simd_neg(double *r, const double *a)
+{
+	__m128d	v = _mm_set1_pd(-0.0);
+
+  _mm_storeu_pd(r,   _mm_xor_pd(_mm_loadu_pd(a),   v));
+  _mm_storeu_pd(r+2, _mm_xor_pd(_mm_loadu_pd(a+2), v));
+}
+inline void simd_add(double *r, const double *a, const double *b)
+{
+  _mm_storeu_pd(r,   _mm_add_pd(_mm_loadu_pd(a),   _mm_loadu_pd(b)));
+  _mm_storeu_pd(r+2, _mm_add_pd(_mm_loadu_pd(a+2), _mm_loadu_pd(b+2)));
+}
+inline void simd_sub(double *r, const double *a, const double *b)
+{
+  _mm_storeu_pd(r,   _mm_sub_pd(_mm_loadu_pd(a),   _mm_loadu_pd(b)));
+  _mm_storeu_pd(r+2, _mm_sub_pd(_mm_loadu_pd(a+2), _mm_loadu_pd(b+2)));
+}
+inline void simd_mul(double *r, const double *a, const double *b)
+{
+  _mm_storeu_pd(r,   _mm_mul_pd(_mm_loadu_pd(a),   _mm_loadu_pd(b)));
+  _mm_storeu_pd(r+2, _mm_mul_pd(_mm_loadu_pd(a+2), _mm_loadu_pd(b+2)));
+}
+inline void simd_scale(double *r, const double *a, double s)
+{
+	__m128d	v = _mm_set1_pd(s);
+
+  _mm_storeu_pd(r,   _mm_mul_pd(_mm_loadu_pd(a),   v));
+  _mm_storeu_pd(r+2, _mm_mul_pd(_mm_loadu_pd(a+2), v));
+}
+inline void simd_div(double *r, const double *a, double s)
+{
+	__m128d	v = _mm_set1_pd(s);
+
+  _mm_storeu_pd(r,   _mm_div_pd(_mm_loadu_pd(a),   v));
+  _mm_storeu_pd(r+2, _mm_div_pd(_mm_loadu_pd(a+2), v));
+}
+inline void simd_madd(double *r, const double *a, double s)
+{
+	__m128d	v = _mm_set1_pd(s);
+
+  _mm_storeu_pd(r,   _mm_add_pd(_mm_loadu_pd(r),
+                                _mm_mul_pd(_mm_loadu_pd(a), v)));
+  _mm_storeu_pd(r+2, _mm_add_pd(_mm_loadu_pd(r+2),
+                                _mm_mul_pd(_mm_loadu_pd(a+2), v)));
+}
+inline void simd_madd(double *r, const double *a, const double *b)
+{
+  _mm_storeu_pd(r,   _mm_add_pd(_mm_loadu_pd(r),
+                                _mm_mul_pd(_mm_loadu_pd(a), _mm_loadu_pd(b))));
+  _mm_storeu_pd(r+2, _mm_add_pd(_mm_loadu_pd(r+2),
+                                _mm_mul_pd(_mm_loadu_pd(a+2), _mm_loadu_pd(b+2))));
+}
+inline double simd_dot(const double *a, const double *b)
+{
+	double	p[4], s=0.0;
+
+  _mm_storeu_pd(p,   _mm_mul_pd(_mm_loadu_pd(a),   _mm_loadu_pd(b)));
+  _mm_storeu_pd(p+2, _mm_mul_pd(_mm_loadu_pd(a+2), _mm_loadu_pd(b+2)));
+  s += p[0]; s += p[1]; s += p[2];
+
+  return(s);
+}
+#endif
+
+#if defined(__SSE2__)
+inline void simd_neg(float *r, const float *a)
+{ _mm_storeu_ps(r, _mm_xor_ps(_mm_loadu_ps(a), _mm_set1_ps(-0.0f))); }
+inline void simd_add(float *r, const float *a, const float *b)
+{ _mm_storeu_ps(r, _mm_add_ps(_mm_loadu_ps(a), _mm_loadu_ps(b))); }
+inline void simd_sub(float *r, const float *a, const float *b)
+{ _mm_storeu_ps(r, _mm_sub_ps(_mm_loadu_ps(a), _mm_loadu_ps(b))); }
+inline void simd_mul(float *r, const float *a, const float *b)
+{ _mm_storeu_ps(r, _mm_mul_ps(_mm_loadu_ps(a), _mm_loadu_ps(b))); }
+inline void simd_scale(float *r, const float *a, float s)
+{ _mm_storeu_ps(r, _mm_mul_ps(_mm_loadu_ps(a), _mm_set1_ps(s))); }
+inline void simd_div(float *r, const float *a, float s)
+{ _mm_storeu_ps(r, _mm_div_ps(_mm_loadu_ps(a), _mm_set1_ps(s))); }
+inline void simd_madd(float *r, const float *a, float s)
+{
+  _mm_storeu_ps(r, _mm_add_ps(_mm_loadu_ps(r),
+                              _mm_mul_ps(_mm_loadu_ps(a), _mm_set1_ps(s))));
+}
+inline void simd_madd(float *r, const float *a, const float *b)
+{
+  _mm_storeu_ps(r, _mm_add_ps(_mm_loadu_ps(r),
+                              _mm_mul_ps(_mm_loadu_ps(a), _mm_loadu_ps(b))));
+}
+inline float simd_dot(const float *a, const float *b)
+{
+	float	p[4], s=0.0f;
+
+  _mm_storeu_ps(p, _mm_mul_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)));
+  s += p[0]; s += p[1]; s += p[2];
+
+  return(s);
+}
+#endif
+
+#endif
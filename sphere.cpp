@@ -3,8 +3,11 @@
 #include <cassert>
 #include <cmath>
 
+#include "simd.h"
 #include "vector.h"
+#include "precision.h"
 #include "pixel.h"
+#include "aabb.h"
 #include "material.h"
 #include "object.h"
 #include "sphere.h"
@@ -50,14 +53,18 @@ std::istream& sphere_t::get(std::istream& s)
   // eat '}' character
   while(s.good() && s.get(c) && (c != '}'));
 
+  // init
+  r2 = radius * radius;
+  invr = 1.0 / radius;
+
   return s;
 }
 
-double	sphere_t::hits(const vec_t& pos, const vec_t& dir, vec_t& hit, vec_t& N)
+double	sphere_t::hits(const vec_t& pos, const vec_t& dir)
 {
 	vec_t	pc;
 	double	a=1.0,b,c;
-	double	d, t0, t1, tf;
+	double	d, sd, t0, t1, tf=-1.0;
 
   assert(cookie == OBJ_COOKIE);
 
@@ -67,7 +74,7 @@ double	sphere_t::hits(const vec_t& pos, const vec_t& dir, vec_t& hit, vec_t& N)
   // compute coeffs for quadratic formula, a should be 1.0 if dir normalized
   a = dir.dot(dir);
   b = 2.0 * pc.dot(dir);
-  c = pc.dot(pc) - radius * radius;
+  c = pc.dot(pc) - r2;
 
   // determine the discriminant from the quadratic formula
   d = b*b - 4.0*a*c;
@@ -76,25 +83,31 @@ double	sphere_t::hits(const vec_t& pos, const vec_t& dir, vec_t& hit, vec_t& N)
   if(d > 0) {
     // t is the distance from ray's base to hit on sphere, always take the
     // smaller of the two roots as we want the entry wound and not the exit
-    t0 = (-b - sqrt(d))/(2.0*a);
-    t1 = (-b + sqrt(d))/(2.0*a);
-
-    if(t0 > .00001 && t0 < t1)
-    {
-	tf = t0;
-    }
-	else
-	{
-		tf = t1;
-	}
-
-    hit = pos + tf * dir;
-
-    // the final step is to compute the normal at the surface---for a sphere
-    // the normal is simply a vector pointing from the center to the hit point
-    N = 1.0/radius * (hit - center);
+    sd = sqrt(d);
+    t0 = (-b - sd)/(2.0*a);
+    t1 = (-b + sd)/(2.0*a);
+
+    if(t0 > HIT_EPS && t0 < t1) tf = t0;
+    else                       tf = t1;
   }
-     return(tf);
+
+  return(tf);
+}
+
+void	sphere_t::getnormal(const vec_t& hit, vec_t& N)
+{
+  // for a sphere the normal is simply a vector pointing from the center to
+  // the hit point
+  N = invr * (hit - center);
+}
+
+bool	sphere_t::getbounds(aabb_t& box)
+{
+	vec_t	r(radius,radius,radius);
+
+  box = aabb_t(center - r, center + r);
+
+  return true;
 }
 
 
@@ -7,14 +7,18 @@ class sphere_t : public object_t
   // constructors (overloaded)
   sphere_t(std::string token) : \
         object_t(token), \
-	radius(0.0) \
+	radius(0.0), \
+	r2(0.0), \
+	invr(0.0) \
 	{ };
 
   // copy constructor
   sphere_t(const sphere_t& rhs) : \
         object_t(rhs), \
 	center(rhs.center), \
-	radius(rhs.radius)
+	radius(rhs.radius), \
+	r2(rhs.r2), \
+	invr(rhs.invr)
 	{ };
 
   // destructors (default not ok)
@@ -29,8 +33,11 @@ class sphere_t : public object_t
 	    type = rhs.type;
 	    name = rhs.name;
 	    material = rhs.material;
+	    mat = rhs.mat;
 	    center = rhs.center;
 	    radius = rhs.radius;
+	    r2 = rhs.r2;
+	    invr = rhs.invr;
 	  }
           return *this;
 	}
@@ -40,12 +47,17 @@ class sphere_t : public object_t
   std::istream& get(std::istream& s);
 
   // methods
-  double	hits(const vec_t&, const vec_t&, vec_t&, vec_t&);
+  double	hits(const vec_t&, const vec_t&);
+  void		getnormal(const vec_t&, vec_t&);
+  bool		getbounds(aabb_t&);
   vec_t		getcenter()	{ return center; }
+  double	getradius()	{ return radius; }
 
   private:
   vec_t	 center;
   double radius;
+  double r2;		// radius squared (set at load)
+  double invr;		// 1 / radius (set at load)
 };
 
 #endif
@@ -0,0 +1,101 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "simd.h"
+#include "vector.h"
+#include "pixel.h"
+#include "aabb.h"
+#include "camera.h"
+#include "material.h"
+#include "object.h"
+#include "pool.h"
+#include "tiles.h"
+
+std::ostream& operator<<(std::ostream& s, const tiles_t& rhs)
+{
+  s << "tiles: " << rhs.nx << "x" << rhs.ny << " of " << rhs.size;
+  s << " pixels, " << rhs.refs << " refs";
+  if(!rhs.pools.empty()) s << " (" << (double)rhs.refs / rhs.pools.size() << " per tile)";
+
+  return s;
+}
+
+// point on the image plane at pixel coordinates (x,y), as main.cpp
+// computes it for the primary rays
+static vec_t window(camera_t& cam, double x, double y)
+{
+  return vec_t(x/(double)(cam.getw()-1) * cam.getww(),
+               y/(double)(cam.geth()-1) * cam.getwh(), 0.0);
+}
+
+// conservative box/frustum test: the box is out if it lies entirely
+// behind one of the side planes (all of which pass through the eye)
+static bool overlaps(const aabb_t& box, const vec_t& eye, const vec_t *n)
+{
+	vec_t	p;
+
+  for(int j=0; j<4; j++) {
+    // box corner farthest along the plane normal
+    for(int a=0; a<3; a++) p[a] = n[j][a] >= 0.0 ? box.max[a] : box.min[a];
+    if(n[j].dot(p - eye) < 0.0) return false;
+  }
+  return true;
+}
+
+void tiles_t::build(camera_t& cam, int isize,
+                    const std::vector<object_t* >& prims, bool single,
+                    bool fast)
+{
+	vec_t			eye = cam.getview_point();
+	vec_t			c[4], n[4], mid;
+	std::vector<aabb_t>	boxes(prims.size());
+	std::vector<object_t* >	inside;
+	int			w = cam.getw(), h = cam.geth();
+	double			x0, x1, y0, y1;
+
+  size = isize;
+  nx = ny = 0;
+  refs = 0;
+  pools.clear();
+
+  if(size <= 0 || w < 2 || h < 2) { size = 0; return; }
+
+  nx = (w + size - 1) / size;
+  ny = (h + size - 1) / size;
+  pools.resize(nx * ny);
+
+  for(int i=0; i<(int)prims.size(); i++) prims[i]->getbounds(boxes[i]);
+
+  for(int ty=0; ty<ny; ty++) {
+    for(int tx=0; tx<nx; tx++) {
+      // tile window, padded by half a pixel all around
+      x0 = tx * size - 0.5;
+      x1 = ((tx+1) * size < w ? (tx+1) * size : w) - 0.5;
+      y0 = ty * size - 0.5;
+      y1 = ((ty+1) * size < h ? (ty+1) * size : h) - 0.5;
+
+      c[0] = window(cam, x0, y0);
+      c[1] = window(cam, x1, y0);
+      c[2] = window(cam, x1, y1);
+      c[3] = window(cam, x0, y1);
+      mid = window(cam, 0.5 * (x0 + x1), 0.5 * (y0 + y1));
+
+      // side planes through the eye and each window edge, facing inward
+      for(int j=0; j<4; j++) {
+        n[j] = (c[j] - eye).cross(c[(j+1)%4] - eye);
+        if(n[j].dot(mid - eye) < 0.0) n[j] = -n[j];
+      }
+
+      inside.clear();
+      for(int i=0; i<(int)prims.size(); i++)
+        if(overlaps(boxes[i], eye, n)) inside.push_back(prims[i]);
+
+      pools[ty * nx + tx].setsingle(single);
+      pools[ty * nx + tx].setfast(fast);
+      pools[ty * nx + tx].build(inside);
+      refs += inside.size();
+    }
+  }
+}
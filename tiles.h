@@ -0,0 +1,47 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include <vector>
+
+// per-tile object lists for primary rays: the screen is cut into square
+// tiles of size x size pixels and every bounded object whose box overlaps
+// a tile's view frustum (eye through the tile's window on the image plane)
+// goes in that tile's compiled pool, so primary rays only test the few
+// objects that can possibly be seen through their own tile
+class tiles_t
+{
+  public:
+  // constructors
+  tiles_t() : \
+	size(0), \
+	nx(0), \
+	ny(0), \
+	refs(0), \
+	pools() \
+	{ };
+
+  // copy constructor (default member copies ok)
+  // destructors (default ok, objects are owned by the model)
+
+  // friends
+  friend std::ostream& operator<<(std::ostream& s, const tiles_t& rhs);
+
+  // methods
+  int			count() const	{ return (int)pools.size(); }
+  // tile holding pixel (x,y), -1 if tiling is off
+  int			which(int x, int y) const
+				{ return size > 0 ? (y/size)*nx + x/size : -1; }
+  const spheres_t&	getpool(int t) const	{ return pools[t]; }
+
+  void			build(camera_t& cam, int isize,
+			      const std::vector<object_t* >& prims,
+			      bool single = false, bool fast = false);
+
+  private:
+  int			size;		// tile size in pixels, 0: off
+  int			nx, ny;		// tiles across and down
+  long			refs;		// total object references
+  std::vector<spheres_t>	pools;		// per tile objects
+};
+
+#endif
@@ -1,57 +1,74 @@
 #include <iostream>
 #include <cmath>
 
+#include "simd.h"
 #include "vector.h"
 
 // compute the dot product of two vectors
-double vec_t::dot(const vec_t& rhs) const
+template <typename T>
+T vec3_t<T>::dot(const vec3_t& rhs) const
 {
-	double	s=0.0;
-
-  for(int i=0;i<3;i++) s += vec[i] * rhs[i];
+  return(simd_dot(vec, rhs.vec));
+}
 
-  return(s);
+// compute the cross product of two vectors
+template <typename T>
+vec3_t<T> vec3_t<T>::cross(const vec3_t& rhs) const
+{
+  return(vec3_t(vec[1]*rhs[2] - vec[2]*rhs[1],
+               vec[2]*rhs[0] - vec[0]*rhs[2],
+               vec[0]*rhs[1] - vec[1]*rhs[0]));
 }
 
 // compute the length of the vector v1
-double vec_t::len() const
+template <typename T>
+T vec3_t<T>::len() const
 {
   return(sqrt(dot(*this)));
 }
 
-// compute the dot product of two vectors
-vec_t vec_t::norm() const
+// compute the unit vector
+template <typename T>
+vec3_t<T> vec3_t<T>::norm() const
 {
-	vec_t	result(*this);
-	double	length = len();
+	T	length;
 
-  for(int i=0;i<3;i++) result[i] /= length;
+  return(norm(length));
+}
+
+// compute the unit vector, and hand back the length divided out
+template <typename T>
+vec3_t<T> vec3_t<T>::norm(T& length) const
+{
+	vec3_t	result;
+
+  length = len();
+  simd_div(result.vec, vec, length);
 
   return(result);
 }
 
 // compute the reflection vector: v = u - 2 (u dot n) n
-vec_t vec_t::reflect(const vec_t& n) const
+template <typename T>
+vec3_t<T> vec3_t<T>::reflect(const vec3_t& n) const
 {
-	vec_t	u(*this);
-	vec_t	result;
+	vec3_t	result(*this);
 
   // u - 2 (u dot n) n
-  result = u - 2.0 * u.dot(n) * n;
-
-  return result;
+  return result.madd(n, -2.0 * dot(n));
 }
 
 // compute the refraction vector
-vec_t vec_t::refract(const vec_t& N, double n2) const
+template <typename T>
+vec3_t<T> vec3_t<T>::refract(const vec3_t& N, double n2) const
 {
 	const float n1 = 1.000293;
 	double	x;
 	double	z;
-	vec_t  refraction;
-	vec_t  u(*this);
+	vec3_t  refraction;
+	vec3_t  u(*this);
 
-	x = (1 - (pow((n1 / n2), 2) * (1 - pow(u.dot(N), 2))));
+	x = (1 - (((n1 / n2) * (n1 / n2)) * (1 - (u.dot(N) * u.dot(N)))));
 
 	if(x < 0)
 		{return(u.reflect(N));}
@@ -63,15 +80,16 @@ vec_t vec_t::refract(const vec_t& N, double n2) const
 }
 
 // compute the refraction vector
-vec_t vec_t::defract(const vec_t& N, double n2) const
+template <typename T>
+vec3_t<T> vec3_t<T>::defract(const vec3_t& N, double n2) const
 {
 	const float n1 = 1.000293;
 	double	x;
 	double	z;
-	vec_t  refraction;
-	vec_t  u(*this);
+	vec3_t  refraction;
+	vec3_t  u(*this);
 
-	x = (1 - (pow((n1 / n2), 2) * (1 - pow(u.dot(N), 2))));
+	x = (1 - (((n1 / n2) * (n1 / n2)) * (1 - (u.dot(N) * u.dot(N)))));
 
 	if(x < 0)
 		{return(u.reflect(N));}
@@ -82,3 +100,6 @@ vec_t vec_t::defract(const vec_t& N, double n2) const
 	return(refraction);
 }
 
+// explicit instantiations
+template class vec3_t<double>;
+template class vec3_t<float>;
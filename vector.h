@@ -1,24 +1,32 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 
-class vec_t
+// 3-vector on scalar type T (float or double), see typedefs below; stored
+// padded to 4 lanes, arithmetic goes through the kernels in simd.h
+template <typename T>
+class vec3_t
 {
   public:
   // constructors (overloaded)
-  vec_t(double ix=0.0, double iy=0.0, double iz=0.0) \
-  { vec[0] = ix; vec[1] = iy; vec[2] = iz; };
+  vec3_t(T ix=0.0, T iy=0.0, T iz=0.0) \
+  { vec[0] = ix; vec[1] = iy; vec[2] = iz; vec[3] = 0.0; };
 
   // copy constructor
-  vec_t(const vec_t& rhs) \
-  { for(int i=0; i<3; i++) vec[i] = rhs[i]; }
+  vec3_t(const vec3_t& rhs) \
+  { for(int i=0; i<4; i++) vec[i] = rhs.vec[i]; }
+
+  // conversion from the other precision
+  template <typename U>
+  explicit vec3_t(const vec3_t<U>& rhs) \
+  { for(int i=0; i<3; i++) vec[i] = (T)rhs[i]; vec[3] = 0.0; }
 
   // destructors (but default ok)
-  ~vec_t()	{ };
+  ~vec3_t()	{ };
 
   // assignment operator
-  vec_t& operator=(const vec_t& rhs)
+  vec3_t& operator=(const vec3_t& rhs)
   {
-    if(this != &rhs) for(int i=0; i<3; i++) vec[i] = rhs[i];
+    if(this != &rhs) for(int i=0; i<4; i++) vec[i] = rhs.vec[i];
 
     return *this;
   }
@@ -26,40 +34,49 @@ class vec_t
   // compound assignment operator +=
   // style notes from:
   // http://www.cs.caltech.edu/courses/cs11/material/cpp/donnie/cpp-ops.html
-  vec_t& operator+=(const vec_t& rhs)
+  vec3_t& operator+=(const vec3_t& rhs)
   {
-    if(this != &rhs) for(int i=0; i<3; i++) vec[i] += rhs[i];
+    if(this != &rhs) simd_add(vec, vec, rhs.vec);
 
     return *this;
   }
 
-  vec_t& operator*=(const vec_t& rhs)
+  vec3_t& operator*=(const vec3_t& rhs)
   {
-    if(this != &rhs) for(int i=0; i<3; i++) vec[i] *= rhs[i];
+    if(this != &rhs) simd_mul(vec, vec, rhs.vec);
+
+    return *this;
+  }
+
+  // fused multiply-add: this += a * s, without the temporaries of the
+  // operator form (same result)
+  vec3_t& madd(const vec3_t& a, T s)
+  {
+    simd_madd(vec, a.vec, s);
 
     return *this;
   }
 
   // accessors
-  const double& operator[](int i) const  { return vec[i]; }
-  double& operator[](int i)              { return vec[i]; }
+  const T& operator[](int i) const  { return vec[i]; }
+  T& operator[](int i)              { return vec[i]; }
 
   // unary operator
-  vec_t operator-() const
+  vec3_t operator-() const
   {
-	vec_t	result;
+	vec3_t	result;
 
-    for(int i=0; i<3; i++) result[i] = -vec[i];
+    simd_neg(result.vec, vec);
 
     return result;
   }
 
   // operators
-  vec_t operator-(const vec_t& rhs) const
+  vec3_t operator-(const vec3_t& rhs) const
   {
-	vec_t	result;
+	vec3_t	result;
 
-    for(int i=0; i<3; i++) result[i] = vec[i] - rhs[i];
+    simd_sub(result.vec, vec, rhs.vec);
 
     return result;
   }
@@ -67,53 +84,59 @@ class vec_t
   // add this instance's value to rhs, and return a new instance with result
   // from:
   // http://www.cs.caltech.edu/courses/cs11/material/cpp/donnie/cpp-ops.html
-  const vec_t operator+(const vec_t& rhs) const {
-    return vec_t(*this) += rhs;
+  const vec3_t operator+(const vec3_t& rhs) const {
+    return vec3_t(*this) += rhs;
   }
  
-  const vec_t operator*(const vec_t& rhs) const {
-    return vec_t(*this) *= rhs;
+  const vec3_t operator*(const vec3_t& rhs) const {
+    return vec3_t(*this) *= rhs;
   }
 
-  friend vec_t operator*(const vec_t& lhs, const double& s)
+  friend vec3_t operator*(const vec3_t& lhs, const T& s)
   {
-	vec_t	result;
+	vec3_t	result;
 
-    for(int i=0; i<3; i++) result[i] = s * lhs[i];
+    simd_scale(result.vec, lhs.vec, s);
 
     return result;
   }
 
-  friend vec_t operator*(const double& s, const vec_t& rhs)
+  friend vec3_t operator*(const T& s, const vec3_t& rhs)
   {
-	vec_t	result;
+	vec3_t	result;
 
-    for(int i=0; i<3; i++) result[i] = s * rhs[i];
+    simd_scale(result.vec, rhs.vec, s);
 
     return result;
   }
 
   // friends
-  friend std::ostream& operator<<(std::ostream& s, const vec_t& rhs)
+  friend std::ostream& operator<<(std::ostream& s, const vec3_t& rhs)
   { return(s << rhs[0] << " " << rhs[1] << " " << rhs[2]); }
-  friend std::ostream& operator<<(std::ostream& s, vec_t *rhs)
+  friend std::ostream& operator<<(std::ostream& s, vec3_t *rhs)
   { return(s << (*rhs)); }
 
-  friend std::istream& operator>>(std::istream& s, vec_t& rhs)
+  friend std::istream& operator>>(std::istream& s, vec3_t& rhs)
   { return(s >> rhs[0] >> rhs[1] >> rhs[2]); }
-  friend std::istream& operator>>(std::istream& s, vec_t *rhs)
+  friend std::istream& operator>>(std::istream& s, vec3_t *rhs)
   { return(s >> (*rhs)); }
 
   // members
-  double dot(const vec_t&) const;
-  double len() const;
-  vec_t	 norm() const;
-  vec_t  reflect(const vec_t&) const;
-  vec_t  refract(const vec_t& n, double n_t) const;
-  vec_t  defract(const vec_t& n, double n_t) const;
+  T      dot(const vec3_t&) const;
+  vec3_t cross(const vec3_t&) const;
+  T      len() const;
+  vec3_t norm() const;
+  vec3_t norm(T& length) const;			// also hands back len()
+  vec3_t reflect(const vec3_t&) const;
+  vec3_t refract(const vec3_t& n, double n_t) const;
+  vec3_t defract(const vec3_t& n, double n_t) const;
 
   private:
-  double vec[3];
+  T vec[simd_t<T>::lanes];
 };
 
+// shading and accumulation run in double, intersection may run in float
+typedef vec3_t<double>	vec_t;
+typedef vec3_t<float>	fvec_t;
+
 #endif
@@ -0,0 +1,285 @@
+#include <omp.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+
+#include "simd.h"
+#include "vector.h"
+#include "pixel.h"
+#include "aabb.h"
+#include "camera.h"
+#include "options.h"
+#include "light.h"
+#include "material.h"
+#include "object.h"
+#include "list.h"
+#include "plane.h"
+#include "pool.h"
+#include "accel.h"
+#include "bvh.h"
+#include "grid.h"
+#include "tiles.h"
+#include "lightgrid.h"
+#include "model.h"
+#include "photon.h"
+#include "ray.h"
+#include "kdtree.h"
+#include "wavefront.h"
+
+// the queues and scratch arrays are sized for a full batch, and the
+// deepest levels allowed, up front, so rendering allocates nothing
+wavefront_t::wavefront_t() : \
+	ray(), \
+	tile(), \
+	bins(), \
+	keys(), \
+	order()
+{
+  frames[0].reserve(WAVE_BATCH);
+  for(int level=1; level<=RAY_DEPTH; level++) frames[level].reserve(WAVE_LEVEL);
+  for(int level=0; level<=RAY_DEPTH; level++)
+    child[level].reserve(2 * std::max(WAVE_BATCH, WAVE_LEVEL));
+  tile.reserve(WAVE_BATCH);
+  bins.reserve(std::max(WAVE_BATCH, WAVE_LEVEL));
+  keys.reserve(WAVE_LEVEL);
+  order.reserve(WAVE_LEVEL);
+}
+
+// primary rays of pixels first .. first+n-1 (row major), as main() makes
+// them for the other engine
+void wavefront_t::generate(model_t& model, int first, int n)
+{
+	int		w=model.getpixel_w(), h=model.getpixel_h();
+	double		ww=model.getworld_w(), wh=model.getworld_h();
+	vec_t		pos=model.getviewpoint();
+
+  frames[0].resize(n);
+  tile.resize(n);
+
+  #pragma omp parallel for schedule(static)
+  for(int i=0; i<n; i++) {
+	ray_t::frame_t&	f = frames[0][i];
+	int		x = (first + i) % w, y = (first + i) / w;
+	double		wx = (double)x/(double)(w-1) * ww;
+	double		wy = (double)y/(double)(h-1) * wh;
+	vec_t		pix(wx,wy,0.0);
+
+    f = ray_t::frame_t();
+    f.pos = pos;
+    f.dir = pix - pos;
+    f.dir = f.dir.norm();
+    f.weight = rgb_t<double>(1.0,1.0,1.0);
+    f.seed = ray_t::rootseed(f.dir);
+    tile[i] = model.gettile(x,y);
+  }
+}
+
+// spread the low 10 bits of x to every third bit (morton order)
+static unsigned spread(unsigned x)
+{
+  x &= 0x3ff;
+  x = (x | (x << 16)) & 0x030000ff;
+  x = (x | (x << 8))  & 0x0300f00f;
+  x = (x | (x << 4))  & 0x030c30c3;
+  x = (x | (x << 2))  & 0x09249249;
+
+  return x;
+}
+
+// order a queue of secondary rays by a coherence key: the direction
+// octant, then the origin's cell (in morton order) on a grid over the
+// queue's origins. rays traced one after the other then mostly start in
+// the same place heading the same way and walk the same acceleration
+// structure nodes
+void wavefront_t::reorder(int level)
+{
+	std::vector<ray_t::frame_t>&	q = frames[level];
+	aabb_t				box;
+	vec_t				scale;
+	int				n = (int)q.size();
+
+  for(int i=0; i<n; i++) box.grow(q[i].pos);
+  for(int a=0; a<3; a++)
+    scale[a] = box.max[a] > box.min[a] ?
+               ((1 << WAVE_CELL_BITS) - 1) / (box.max[a] - box.min[a]) : 0.0;
+
+  keys.resize(n);
+
+  #pragma omp parallel for schedule(static)
+  for(int i=0; i<n; i++) {
+	const ray_t::frame_t&	f = q[i];
+	unsigned		key = 0;
+
+    for(int a=0; a<3; a++) {
+      key |= (f.dir[a] < 0.0 ? 1u : 0u) << (3 * WAVE_CELL_BITS + a);
+      key |= spread((unsigned)((f.pos[a] - box.min[a]) * scale[a])) << a;
+    }
+    keys[i] = std::make_pair(key, i);
+  }
+  std::sort(keys.begin(), keys.end());
+
+  order.resize(n);
+  for(int j=0; j<n; j++) order[j] = keys[j].second;
+}
+
+// closest hits of a level's rays, in queue order or the one reorder()
+// made; a ray that hits nothing (or too far off) is dead, obj NULL, and
+// black
+void wavefront_t::intersect(model_t& model, int level, bool sorted)
+{
+	std::vector<ray_t::frame_t>&	q = frames[level];
+
+  #pragma omp parallel for schedule(dynamic,WAVE_CHUNK)
+  for(int j=0; j<(int)q.size(); j++) {
+	int		i = sorted ? order[j] : j;
+	ray_t::frame_t&	f = q[i];
+
+    f.obj = model.find_closest(f.pos,f.dir,f.dis,f.hit,f.N,
+                               level == 0 ? tile[i] : -1);
+    if(f.obj && f.dis > MAX_DIST) f.obj = NULL;
+    f.color.zero();
+  }
+}
+
+// local shading of a level's live rays, binned by material so each bin
+// runs one class's kernel over one material
+void wavefront_t::shade(model_t& model, int level)
+{
+	std::vector<ray_t::frame_t>&	q = frames[level];
+
+  bins.clear();
+  for(int i=0; i<(int)q.size(); i++)
+    if(q[i].obj) bins.push_back(std::make_pair(q[i].obj->getmat(), i));
+  std::sort(bins.begin(), bins.end());
+
+  #pragma omp parallel for schedule(dynamic,WAVE_CHUNK)
+  for(int b=0; b<(int)bins.size(); b++)
+    ray.local(model,q[bins[b].second]);
+}
+
+// reflected and refracted rays of a level's live rays into the next
+// queue, those not worth tracing dropped. frame i's are given slots in
+// order (child[2i] and child[2i+1]), made, then the queue is compacted.
+// false, and nothing made, if the next level would be over WAVE_LEVEL
+bool wavefront_t::emit(model_t& model, int level)
+{
+	std::vector<ray_t::frame_t>&	q = frames[level];
+	std::vector<ray_t::frame_t>&	next = frames[level + 1];
+	std::vector<int>&		c = child[level];
+	int				n = 0;
+
+  c.assign(2 * q.size(), -1);
+  if(level + 1 > RAY_DEPTH) return true;
+
+  for(int i=0; i<(int)q.size(); i++) {
+    if(!q[i].obj) continue;
+    if(q[i].cls & MAT_SPECULAR) c[2*i] = n++;
+    if(q[i].cls & MAT_TRANSMIT) c[2*i+1] = n++;
+  }
+  if(n > WAVE_LEVEL) return false;
+
+  next.resize(n);
+
+  #pragma omp parallel for schedule(dynamic,WAVE_CHUNK)
+  for(int i=0; i<(int)q.size(); i++) {
+	ray_t::frame_t&	f = q[i];
+
+    if(c[2*i] >= 0) {
+      ray.reflection(model,f,next[c[2*i]]);
+      if(!ray.keep(model,next[c[2*i]])) c[2*i] = -1;
+    }
+    if(c[2*i+1] >= 0) {
+      ray.refraction(model,f,next[c[2*i+1]]);
+      if(!ray.keep(model,next[c[2*i+1]])) c[2*i+1] = -1;
+    }
+  }
+
+  // slots only ever move down
+  n = 0;
+  for(int k=0; k<(int)c.size(); k++) {
+    if(c[k] < 0) continue;
+    if(n != c[k]) next[n] = next[c[k]];
+    c[k] = n++;
+  }
+  next.resize(n);
+
+  return true;
+}
+
+// finish a level's frames with the colors their children handed back
+// (black for a child never traced); a frame's color is then the one it
+// hands back to its parent
+void wavefront_t::resolve(model_t& model, int level)
+{
+	std::vector<ray_t::frame_t>&	q = frames[level];
+	std::vector<int>&		c = child[level];
+
+  #pragma omp parallel for schedule(dynamic,WAVE_CHUNK)
+  for(int i=0; i<(int)q.size(); i++) {
+	ray_t::frame_t&	f = q[i];
+	rgb_t<double>	ret;
+
+    if(!f.obj) continue;
+    if(f.cls & MAT_SPECULAR) {
+      if(c[2*i] >= 0) ret = frames[level + 1][c[2*i]].color;
+      else            ret.zero();
+      ray.reflected(f,ret);
+    }
+    if(f.cls & MAT_TRANSMIT) {
+      if(c[2*i+1] >= 0) ret = frames[level + 1][c[2*i+1]].color;
+      else              ret.zero();
+      ray.refracted(f,ret);
+    }
+    ray.finish(model,f,ret);
+    f.color = ret;
+  }
+}
+
+// trace primary rays first .. first+n-1 to the end and blend their
+// colors; false if a level overflowed (and the batch must be split)
+bool wavefront_t::trace(model_t& model, int first, int n)
+{
+	bool		sorted;
+
+  // down: trace and shade a bounce level at a time
+  generate(model,first,n);
+  for(int level=0; level<=RAY_DEPTH; level++) {
+    sorted = level > 0 && model.getreorder();
+    if(sorted) reorder(level);
+    intersect(model,level,sorted);
+    shade(model,level);
+    if(!emit(model,level)) return false;
+  }
+
+  // up: blend the colors back to the primary rays
+  for(int level=RAY_DEPTH; level>=0; level--) resolve(model,level);
+
+  return true;
+}
+
+void wavefront_t::render(model_t& model, rgb_t<uchar> *img)
+{
+	int		w=model.getpixel_w(), h=model.getpixel_h(), n;
+	int		batch = WAVE_BATCH;
+	rgb_t<uchar>	*imgloc;
+
+  // a batch too big for the level cap is halved, for the rest of the frame
+  // too (a single ray's levels always fit)
+  for(int first=0; first<w*h; first+=n) {
+    n = std::min(batch, w*h - first);
+    if(!trace(model,first,n)) {
+      batch = (n + 1) / 2;
+      n = 0;
+      continue;
+    }
+
+    for(int i=0; i<n; i++) {
+      imgloc = img + first + i;
+      for(int j=0; j<3; j++)
+        (*imgloc)[j] = static_cast<uchar>(255.0 * frames[0][i].color[j]);
+    }
+  }
+}
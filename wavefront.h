@@ -0,0 +1,62 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include <vector>
+#include <utility>
+
+#define WAVE_BATCH	16384	// primary rays in flight
+#define WAVE_LEVEL	16384	// most rays on a bounce level (>= 2^RAY_DEPTH)
+#define WAVE_CHUNK	64	// rays per scheduling chunk
+#define WAVE_CELL_BITS	9	// reorder: 2^bits origin cells per axis (<= 10)
+
+// breadth-first renderer ('engine wavefront' in the options block): a
+// batch of primary rays goes through the stages together, one bounce
+// level at a time. the level's rays are intersected, their hits binned by
+// material and shaded, and the reflected and refracted rays that survive
+// are emitted into the next level's queue. once the deepest level is done
+// the colors are blended back up, level by level, each frame with its
+// children's. every step on a frame is the one ray_t::shade() takes, so
+// the image is the same as the other engine's. with 'reorder on' each
+// queue of secondary rays is traced in an order sorted for coherence.
+// every ray can spawn two, so a batch's deeper levels could grow to
+// 2^level times the batch; each level is capped at WAVE_LEVEL rays
+// instead, and a batch that would go over is traced again at half the
+// size. the queues, RAY_DEPTH + 1 of them at 280 bytes a ray (~27 MB),
+// are all reserved when the renderer is made
+class wavefront_t
+{
+  public:
+  // constructors
+  wavefront_t();
+
+  // copy constructor (default member copies ok)
+  // destructors (default ok)
+
+  // methods
+  void	render(model_t& model, rgb_t<uchar> *img);
+
+  private:
+  bool	trace(model_t&, int first, int n);
+  void	generate(model_t&, int first, int n);
+  void	reorder(int level);
+  void	intersect(model_t&, int level, bool sorted);
+  void	shade(model_t&, int level);
+  bool	emit(model_t&, int level);
+  void	resolve(model_t&, int level);
+
+  // queue of rays per bounce level (one spare, always empty, past the
+  // deepest) and for each ray the frames of its reflected and refracted
+  // rays in the next queue, -1 for none
+  std::vector<ray_t::frame_t>	frames[RAY_DEPTH + 2];
+  std::vector<int>		child[RAY_DEPTH + 1];
+
+  ray_t				ray;		// frame steps
+  std::vector<int>		tile;		// primary ray tiles
+  std::vector<std::pair<const material_t*, int> >	bins;	// shading order
+
+  // reorder: sort keys, and the queue indices in key order
+  std::vector<std::pair<unsigned, int> >	keys;
+  std::vector<int>				order;
+};
+
+#endif